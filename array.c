@@ -0,0 +1,245 @@
+#include "common.h"
+#include "array.h"
+
+#if defined(__AVX__)
+#define F64_LANES 4
+#elif defined(__SSE2__)
+#define F64_LANES 2
+#endif
+
+#ifdef F64_LANES
+typedef double f64v __attribute__((vector_size(F64_LANES * sizeof(double))));
+typedef int64_t i64v __attribute__((vector_size(F64_LANES * sizeof(int64_t))));
+
+/* the arrays aren't aligned, so loads go through memcpy */
+static f64v
+f64v_load(const double *x)
+{
+        f64v v;
+        memcpy(&v, x, sizeof(v));
+        return v;
+}
+
+/* lanewise select, mask lanes are all ones or all zeros */
+static f64v
+f64v_select(i64v mask, f64v a, f64v b)
+{
+        return (f64v)((mask & (i64v)a) | (~mask & (i64v)b));
+}
+#endif
+
+double
+brd_array_f64_sum(const double *x, size_t n)
+{
+        double sum = 0;
+        size_t i = 0;
+
+#ifdef F64_LANES
+        /* two accumulators to hide the latency of the adds */
+        f64v acc0 = { 0 }, acc1 = { 0 };
+
+        for (; i + 2 * F64_LANES <= n; i += 2 * F64_LANES) {
+                acc0 += f64v_load(x + i);
+                acc1 += f64v_load(x + i + F64_LANES);
+        }
+        acc0 += acc1;
+        for (int j = 0; j < F64_LANES; j++) {
+                sum += acc0[j];
+        }
+#endif
+
+        for (; i < n; i++) {
+                sum += x[i];
+        }
+        return sum;
+}
+
+double
+brd_array_f64_dot(const double *x, const double *y, size_t n)
+{
+        double sum = 0;
+        size_t i = 0;
+
+#ifdef F64_LANES
+        f64v acc0 = { 0 }, acc1 = { 0 };
+
+        for (; i + 2 * F64_LANES <= n; i += 2 * F64_LANES) {
+                acc0 += f64v_load(x + i) * f64v_load(y + i);
+                acc1 += f64v_load(x + i + F64_LANES) * f64v_load(y + i + F64_LANES);
+        }
+        acc0 += acc1;
+        for (int j = 0; j < F64_LANES; j++) {
+                sum += acc0[j];
+        }
+#endif
+
+        for (; i < n; i++) {
+                sum += x[i] * y[i];
+        }
+        return sum;
+}
+
+/* n must not be 0 */
+double
+brd_array_f64_min(const double *x, size_t n)
+{
+        double min = x[0];
+        size_t i = 0;
+
+#ifdef F64_LANES
+        if (n >= F64_LANES) {
+                f64v acc = f64v_load(x);
+
+                for (i = F64_LANES; i + F64_LANES <= n; i += F64_LANES) {
+                        f64v v = f64v_load(x + i);
+                        acc = f64v_select(v < acc, v, acc);
+                }
+                for (int j = 0; j < F64_LANES; j++) {
+                        min = acc[j] < min ? acc[j] : min;
+                }
+        }
+#endif
+
+        for (; i < n; i++) {
+                min = x[i] < min ? x[i] : min;
+        }
+        return min;
+}
+
+/* n must not be 0 */
+double
+brd_array_f64_max(const double *x, size_t n)
+{
+        double max = x[0];
+        size_t i = 0;
+
+#ifdef F64_LANES
+        if (n >= F64_LANES) {
+                f64v acc = f64v_load(x);
+
+                for (i = F64_LANES; i + F64_LANES <= n; i += F64_LANES) {
+                        f64v v = f64v_load(x + i);
+                        acc = f64v_select(v > acc, v, acc);
+                }
+                for (int j = 0; j < F64_LANES; j++) {
+                        max = acc[j] > max ? acc[j] : max;
+                }
+        }
+#endif
+
+        for (; i < n; i++) {
+                max = x[i] > max ? x[i] : max;
+        }
+        return max;
+}
+
+void
+brd_array_f64_scale(double *x, double k, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                x[i] *= k;
+        }
+}
+
+void
+brd_array_f64_axpy(double a, const double *x, double *y, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                y[i] += a * x[i];
+        }
+}
+
+void
+brd_array_f64_add(double *out, const double *x, const double *y, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                out[i] = x[i] + y[i];
+        }
+}
+
+void
+brd_array_f64_mul(double *out, const double *x, const double *y, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                out[i] = x[i] * y[i];
+        }
+}
+
+/* integer arithmetic wraps around instead of overflowing */
+int64_t
+brd_array_i64_sum(const int64_t *x, size_t n)
+{
+        uint64_t sum = 0;
+
+        for (size_t i = 0; i < n; i++) {
+                sum += (uint64_t)x[i];
+        }
+        return (int64_t)sum;
+}
+
+int64_t
+brd_array_i64_dot(const int64_t *x, const int64_t *y, size_t n)
+{
+        uint64_t sum = 0;
+
+        for (size_t i = 0; i < n; i++) {
+                sum += (uint64_t)x[i] * (uint64_t)y[i];
+        }
+        return (int64_t)sum;
+}
+
+/* n must not be 0 */
+int64_t
+brd_array_i64_min(const int64_t *x, size_t n)
+{
+        int64_t min = x[0];
+
+        for (size_t i = 1; i < n; i++) {
+                min = x[i] < min ? x[i] : min;
+        }
+        return min;
+}
+
+/* n must not be 0 */
+int64_t
+brd_array_i64_max(const int64_t *x, size_t n)
+{
+        int64_t max = x[0];
+
+        for (size_t i = 1; i < n; i++) {
+                max = x[i] > max ? x[i] : max;
+        }
+        return max;
+}
+
+void
+brd_array_i64_scale(int64_t *x, int64_t k, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                x[i] = (int64_t)((uint64_t)x[i] * (uint64_t)k);
+        }
+}
+
+void
+brd_array_i64_axpy(int64_t a, const int64_t *x, int64_t *y, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                y[i] = (int64_t)((uint64_t)y[i] + (uint64_t)a * (uint64_t)x[i]);
+        }
+}
+
+void
+brd_array_i64_add(int64_t *out, const int64_t *x, const int64_t *y, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                out[i] = (int64_t)((uint64_t)x[i] + (uint64_t)y[i]);
+        }
+}
+
+void
+brd_array_i64_mul(int64_t *out, const int64_t *x, const int64_t *y, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                out[i] = (int64_t)((uint64_t)x[i] * (uint64_t)y[i]);
+        }
+}
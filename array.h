@@ -0,0 +1,28 @@
+#ifndef BRD_ARRAY_H
+#define BRD_ARRAY_H
+
+/*
+ * Kernels for typed arrays. The f64 reductions are written with vector
+ * types so that they use AVX or SSE when the target has them, with a plain
+ * loop for everything else. The elementwise kernels and the i64 kernels
+ * are simple enough for the compiler to vectorize by itself.
+ */
+double brd_array_f64_sum(const double *x, size_t n);
+double brd_array_f64_dot(const double *x, const double *y, size_t n);
+double brd_array_f64_min(const double *x, size_t n);
+double brd_array_f64_max(const double *x, size_t n);
+void brd_array_f64_scale(double *x, double k, size_t n);
+void brd_array_f64_axpy(double a, const double *x, double *y, size_t n);
+void brd_array_f64_add(double *out, const double *x, const double *y, size_t n);
+void brd_array_f64_mul(double *out, const double *x, const double *y, size_t n);
+
+int64_t brd_array_i64_sum(const int64_t *x, size_t n);
+int64_t brd_array_i64_dot(const int64_t *x, const int64_t *y, size_t n);
+int64_t brd_array_i64_min(const int64_t *x, size_t n);
+int64_t brd_array_i64_max(const int64_t *x, size_t n);
+void brd_array_i64_scale(int64_t *x, int64_t k, size_t n);
+void brd_array_i64_axpy(int64_t a, const int64_t *x, int64_t *y, size_t n);
+void brd_array_i64_add(int64_t *out, const int64_t *x, const int64_t *y, size_t n);
+void brd_array_i64_mul(int64_t *out, const int64_t *x, const int64_t *y, size_t n);
+
+#endif
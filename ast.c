@@ -516,6 +516,74 @@ brd_node_while_new(int no_list, struct brd_node *cond, struct brd_node *body, st
         return (struct brd_node *)n;
 }
 
+static struct brd_node *
+brd_node_for_in_copy(struct brd_node *n)
+{
+        struct brd_node_for_in *f = (struct brd_node_for_in *)n;
+        return brd_node_for_in_new(
+                f->no_list,
+                f->var,
+                brd_node_copy(f->iter),
+                brd_node_copy(f->body)
+        );
+}
+
+static void
+brd_node_for_in_destroy(struct brd_node *n)
+{
+        struct brd_node_for_in *f = (struct brd_node_for_in *)n;
+        free(f->var);
+        brd_node_destroy(f->iter);
+        brd_node_destroy(f->body);
+}
+
+struct brd_node *
+brd_node_for_in_new(int no_list, char *var, struct brd_node *iter, struct brd_node *body)
+{
+        struct brd_node_for_in *n = malloc(sizeof(*n));
+        n->_node.ntype = BRD_NODE_FOR_IN;
+        n->_node.line_number = line_number;
+        n->no_list = no_list;
+        n->var = strdup(var);
+        n->iter = iter;
+        n->body = body;
+        return (struct brd_node *)n;
+}
+
+static struct brd_node *
+brd_node_inline_copy(struct brd_node *n)
+{
+        struct brd_node_inline *m = (struct brd_node_inline *)n;
+        char **temps = malloc(sizeof(char *) * m->num_temps);
+        for (size_t i = 0; i < m->num_temps; i++) {
+                temps[i] = strdup(m->temps[i]);
+        }
+        return brd_node_inline_new(brd_node_copy(m->body), temps, m->num_temps);
+}
+
+static void
+brd_node_inline_destroy(struct brd_node *n)
+{
+        struct brd_node_inline *m = (struct brd_node_inline *)n;
+        for (size_t i = 0; i < m->num_temps; i++) {
+                free(m->temps[i]);
+        }
+        free(m->temps);
+        brd_node_destroy(m->body);
+}
+
+struct brd_node *
+brd_node_inline_new(struct brd_node *body, char **temps, size_t num_temps)
+{
+        struct brd_node_inline *n = malloc(sizeof(*n));
+        n->_node.ntype = BRD_NODE_INLINE;
+        n->_node.line_number = line_number;
+        n->body = body;
+        n->temps = temps;
+        n->num_temps = num_temps;
+        return (struct brd_node *)n;
+}
+
 static struct brd_node *
 brd_node_field_copy(struct brd_node *n)
 {
@@ -673,6 +741,8 @@ brd_node_destroy(struct brd_node *node)
         case BRD_NODE_ACC_OBJ: brd_node_acc_obj_destroy(node); break;
         case BRD_NODE_SUBCLASS: brd_node_subclass_destroy(node); break;
         case BRD_NODE_DICT: brd_node_dict_destroy(node); break;
+        case BRD_NODE_FOR_IN: brd_node_for_in_destroy(node); break;
+        case BRD_NODE_INLINE: brd_node_inline_destroy(node); break;
         case BRD_NODE_PROGRAM: brd_node_program_destroy(node); break;
         }
         free(node);
@@ -701,7 +771,9 @@ brd_node_copy(struct brd_node *node)
         case BRD_NODE_FIELD: return brd_node_field_copy(node);
         case BRD_NODE_ACC_OBJ: return brd_node_acc_obj_copy(node);
         case BRD_NODE_SUBCLASS: return brd_node_subclass_copy(node);
-        case BRD_NODE_DICT: brd_node_dict_copy(node); break;
+        case BRD_NODE_DICT: return brd_node_dict_copy(node);
+        case BRD_NODE_FOR_IN: return brd_node_for_in_copy(node);
+        case BRD_NODE_INLINE: return brd_node_inline_copy(node);
         case BRD_NODE_PROGRAM: return brd_node_program_copy(node);
         }
         BARF("what?");
@@ -26,6 +26,8 @@ enum brd_node_type {
         BRD_NODE_ACC_OBJ,
         BRD_NODE_SUBCLASS,
         BRD_NODE_DICT,
+        BRD_NODE_FOR_IN,
+        BRD_NODE_INLINE,
 
         BRD_NODE_PROGRAM, /* the top level program */
 };
@@ -187,6 +189,27 @@ struct brd_node_while {
         // inc can be null
 };
 
+/* for var in iter do body end */
+struct brd_node_for_in {
+        struct brd_node _node;
+        char *var;
+        struct brd_node *iter;
+        struct brd_node *body;
+        int no_list;
+        char _p[4];
+};
+
+/*
+ * a closure call which was replaced by the closure's body,
+ * temps are the variables holding its arguments, unset afterwards
+ */
+struct brd_node_inline {
+        struct brd_node _node;
+        struct brd_node *body;
+        char **temps;
+        size_t num_temps;
+};
+
 struct brd_node_field {
         struct brd_node _node;
         struct brd_node *object;
@@ -242,6 +265,8 @@ struct brd_node *brd_node_body_new(struct brd_node **stmts, size_t num_stmts);
 struct brd_node *brd_node_ifexpr_new(struct brd_node *cond, struct brd_node *body, struct brd_node_elif *elifs, size_t num_elifs, struct brd_node *els);
 struct brd_node *brd_node_index_new(struct brd_node *list, struct brd_node *idx);
 struct brd_node *brd_node_while_new(int no_list, struct brd_node *cond, struct brd_node *body, struct brd_node *inc);
+struct brd_node *brd_node_for_in_new(int no_list, char *var, struct brd_node *iter, struct brd_node *body);
+struct brd_node *brd_node_inline_new(struct brd_node *body, char **temps, size_t num_temps);
 struct brd_node *brd_node_field_new(struct brd_node *object, char *field);
 struct brd_node *brd_node_acc_obj_new(struct brd_node *object, char *id);
 struct brd_node *brd_node_subclass_new(struct brd_node *super, struct brd_node *constructor, struct brd_node_subclass_set *decs, size_t num_decs);
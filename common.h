@@ -12,6 +12,10 @@
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 /* 
  * global variables for the parser
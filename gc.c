@@ -0,0 +1,533 @@
+#include "common.h"
+#include "ast.h"
+#include "value.h"
+#include "vm.h"
+#include "gc.h"
+
+#define GRAY_SIZE 64
+#define GROW 1.5
+
+/* a worker only gives away work once it has at least this much of it */
+#define SHARE_THRESHOLD 32
+
+/* how many entries a sweeper takes off the unswept list at once */
+#define SWEEP_CHUNK 256
+
+/* how many entries each allocation sweeps when sweeping lazily */
+#define SWEEP_STEP 8
+
+enum brd_gc_phase {
+        BRD_GC_MARK,
+        BRD_GC_SWEEP,
+        BRD_GC_EXIT,
+};
+
+/*
+ * Every gc thread (including the main thread, which is worker 0)
+ * marks out of its own local gray stack. When another worker is out of work,
+ * half of the local stack is moved to the shared stack where it can be stolen.
+ */
+struct brd_gc_worker {
+        struct brd_gc_stack local, shared;
+        pthread_mutex_t lock; /* guards shared */
+        pthread_t thread;
+        unsigned long generation;
+
+        /* entries this worker found alive while sweeping */
+        struct brd_heap_entry *survivors, *tail;
+        size_t live[BRD_NUM_HEAP_TYPES];
+};
+
+/*
+ * Sweeping is deferred until after the mutator resumes. The heap as it was
+ * at the end of marking is detached into the unswept list. With one thread,
+ * every allocation sweeps a few of its entries; otherwise the other gc
+ * threads sweep it in the background. Whatever is left is swept at the start
+ * of the next collection, before anything gets marked again.
+ */
+struct brd_gc_pool {
+        struct brd_gc_worker worker[GC_MAX_THREADS];
+        pthread_mutex_t lock, sweep_lock;
+        pthread_cond_t start, done;
+        unsigned long generation;
+        unsigned int num_threads, pending, idle;
+        enum brd_gc_phase phase;
+        char _p[3];
+        struct brd_heap_entry *unswept; /* guarded by sweep_lock */
+        int sweeping; /* background sweep in progress */
+        char _p2[4];
+};
+
+static struct brd_gc_pool gc;
+
+struct brd_gc_stats gc_stats;
+
+void
+brd_gc_stack_push(struct brd_gc_stack *stack, struct brd_heap_entry *entry)
+{
+        if (stack->length == stack->capacity) {
+                stack->capacity *= GROW;
+                stack->items = realloc(
+                        stack->items,
+                        sizeof(struct brd_heap_entry *) * stack->capacity
+                );
+        }
+        stack->items[stack->length++] = entry;
+}
+
+static void
+brd_gc_stack_init(struct brd_gc_stack *stack)
+{
+        stack->length = 0;
+        stack->capacity = GRAY_SIZE;
+        stack->items = malloc(sizeof(struct brd_heap_entry *) * stack->capacity);
+}
+
+/* return true if the entry wasn't already marked */
+int
+brd_gc_try_mark(struct brd_heap_entry *entry)
+{
+        /* plain load first so that marked entries don't cost an atomic swap */
+        if (__atomic_load_n(&entry->marked, __ATOMIC_RELAXED)) {
+                return false;
+        }
+        return !__atomic_exchange_n(&entry->marked, true, __ATOMIC_RELAXED);
+}
+
+/* move the bottom half of the local stack to the shared stack */
+static void
+brd_gc_share(struct brd_gc_worker *w)
+{
+        size_t n = w->local.length / 2;
+
+        pthread_mutex_lock(&w->lock);
+        for (size_t i = 0; i < n; i++) {
+                brd_gc_stack_push(&w->shared, w->local.items[i]);
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        w->local.length -= n;
+        memmove(
+                w->local.items,
+                w->local.items + n,
+                sizeof(struct brd_heap_entry *) * w->local.length
+        );
+}
+
+/* take half (rounded up) of the bottom of from's shared stack */
+static int
+brd_gc_take(struct brd_gc_worker *w, struct brd_gc_worker *from)
+{
+        size_t n;
+
+        if (__atomic_load_n(&from->shared.length, __ATOMIC_RELAXED) == 0) {
+                return false;
+        }
+
+        pthread_mutex_lock(&from->lock);
+        n = (from->shared.length + 1) / 2;
+        for (size_t i = 0; i < n; i++) {
+                brd_gc_stack_push(&w->local, from->shared.items[i]);
+        }
+        from->shared.length -= n;
+        memmove(
+                from->shared.items,
+                from->shared.items + n,
+                sizeof(struct brd_heap_entry *) * from->shared.length
+        );
+        pthread_mutex_unlock(&from->lock);
+
+        return n > 0;
+}
+
+static int
+brd_gc_steal(struct brd_gc_worker *w)
+{
+        size_t id = w - gc.worker;
+
+        for (size_t i = 1; i < gc.num_threads; i++) {
+                if (brd_gc_take(w, &gc.worker[(id + i) % gc.num_threads])) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static void
+brd_gc_mark_worker(struct brd_gc_worker *w)
+{
+        for (;;) {
+                while (w->local.length > 0 || brd_gc_take(w, w)) {
+                        struct brd_heap_entry *entry = w->local.items[--w->local.length];
+                        brd_heap_gc_trace(entry, &w->local);
+                        w->live[entry->htype]++;
+                        if (w->local.length > SHARE_THRESHOLD
+                                        && __atomic_load_n(&gc.idle, __ATOMIC_RELAXED) > 0) {
+                                brd_gc_share(w);
+                        }
+                }
+
+                /*
+                 * Only workers with work can create more work, so once every
+                 * worker is idle the mark phase is finished
+                 */
+                __atomic_add_fetch(&gc.idle, 1, __ATOMIC_SEQ_CST);
+                for (;;) {
+                        if (brd_gc_steal(w)) {
+                                __atomic_sub_fetch(&gc.idle, 1, __ATOMIC_SEQ_CST);
+                                break;
+                        } else if (__atomic_load_n(&gc.idle, __ATOMIC_SEQ_CST) == gc.num_threads) {
+                                return;
+                        }
+                        sched_yield();
+                }
+        }
+}
+
+/* take up to n entries off the front of the unswept list */
+static struct brd_heap_entry *
+brd_gc_take_unswept(size_t n)
+{
+        struct brd_heap_entry *chunk, *last;
+
+        if (gc.num_threads > 1) {
+                pthread_mutex_lock(&gc.sweep_lock);
+        }
+        chunk = last = gc.unswept;
+        if (chunk != NULL) {
+                while (--n > 0 && last->next != NULL) {
+                        last = last->next;
+                }
+                gc.unswept = last->next;
+                last->next = NULL;
+        }
+        if (gc.num_threads > 1) {
+                pthread_mutex_unlock(&gc.sweep_lock);
+        }
+        return chunk;
+}
+
+/*
+ * Destroy the dead entries of a chunk and keep the live ones,
+ * clearing their marks for the next collection
+ */
+static void
+brd_gc_sweep_chunk(struct brd_gc_worker *w, struct brd_heap_entry *heap)
+{
+        while (heap != NULL) {
+                struct brd_heap_entry *next = heap->next;
+                if (heap->marked) {
+                        heap->marked = false;
+                        heap->next = w->survivors;
+                        if (w->survivors == NULL) {
+                                w->tail = heap;
+                        }
+                        w->survivors = heap;
+                } else {
+                        brd_heap_destroy(heap);
+                }
+                heap = next;
+        }
+}
+
+static void
+brd_gc_sweep_worker(struct brd_gc_worker *w)
+{
+        struct brd_heap_entry *chunk;
+
+        while ((chunk = brd_gc_take_unswept(SWEEP_CHUNK)) != NULL) {
+                brd_gc_sweep_chunk(w, chunk);
+        }
+}
+
+static void
+brd_gc_run_phase(struct brd_gc_worker *w, enum brd_gc_phase phase)
+{
+        switch (phase) {
+        case BRD_GC_MARK: brd_gc_mark_worker(w); break;
+        case BRD_GC_SWEEP: brd_gc_sweep_worker(w); break;
+        case BRD_GC_EXIT: break;
+        }
+}
+
+static void *
+brd_gc_thread(void *arg)
+{
+        struct brd_gc_worker *w = arg;
+        enum brd_gc_phase phase;
+
+        pthread_mutex_lock(&gc.lock);
+        for (;;) {
+                while (gc.generation == w->generation) {
+                        pthread_cond_wait(&gc.start, &gc.lock);
+                }
+                w->generation = gc.generation;
+                phase = gc.phase;
+                pthread_mutex_unlock(&gc.lock);
+
+                brd_gc_run_phase(w, phase);
+
+                pthread_mutex_lock(&gc.lock);
+                if (--gc.pending == 0) {
+                        pthread_cond_signal(&gc.done);
+                }
+                if (phase == BRD_GC_EXIT) {
+                        pthread_mutex_unlock(&gc.lock);
+                        return NULL;
+                }
+        }
+}
+
+/* start a phase on every gc thread except the calling one */
+static void
+brd_gc_start(enum brd_gc_phase phase)
+{
+        pthread_mutex_lock(&gc.lock);
+        gc.phase = phase;
+        gc.pending = gc.num_threads - 1;
+        gc.generation++;
+        pthread_cond_broadcast(&gc.start);
+        pthread_mutex_unlock(&gc.lock);
+}
+
+static void
+brd_gc_wait(void)
+{
+        pthread_mutex_lock(&gc.lock);
+        while (gc.pending > 0) {
+                pthread_cond_wait(&gc.done, &gc.lock);
+        }
+        pthread_mutex_unlock(&gc.lock);
+}
+
+/* run a phase on every gc thread, the calling thread acts as worker 0 */
+static void
+brd_gc_run(enum brd_gc_phase phase)
+{
+        if (gc.num_threads == 1) {
+                brd_gc_run_phase(&gc.worker[0], phase);
+                return;
+        }
+
+        brd_gc_start(phase);
+        brd_gc_run_phase(&gc.worker[0], phase);
+        brd_gc_wait();
+}
+
+/* sweep a few entries, called on every allocation */
+void
+brd_gc_sweep_step(void)
+{
+        if (gc.unswept != NULL && gc.num_threads == 1) {
+                brd_gc_sweep_chunk(&gc.worker[0], brd_gc_take_unswept(SWEEP_STEP));
+        }
+}
+
+/*
+ * Finish the sweep left over from the last collection
+ * and put the survivors back in the heap
+ */
+void
+brd_gc_finish_sweep(void)
+{
+        if (gc.sweeping) {
+                brd_gc_wait();
+                gc.sweeping = false;
+        }
+        brd_gc_sweep_worker(&gc.worker[0]);
+
+        for (unsigned int i = 0; i < gc.num_threads; i++) {
+                struct brd_gc_worker *w = &gc.worker[i];
+                if (w->survivors != NULL) {
+                        w->tail->next = vm.heap->next;
+                        vm.heap->next = w->survivors;
+                        w->survivors = NULL;
+                }
+        }
+}
+
+void
+brd_gc_init(void)
+{
+        pthread_mutex_init(&gc.lock, NULL);
+        pthread_mutex_init(&gc.sweep_lock, NULL);
+        pthread_cond_init(&gc.start, NULL);
+        pthread_cond_init(&gc.done, NULL);
+        gc.generation = 0;
+        gc.num_threads = 1;
+        gc.unswept = NULL;
+        gc.sweeping = false;
+        gc.worker[0].survivors = NULL;
+
+        brd_gc_stack_init(&gc.worker[0].local);
+        brd_gc_stack_init(&gc.worker[0].shared);
+        pthread_mutex_init(&gc.worker[0].lock, NULL);
+}
+
+void
+brd_gc_set_threads(unsigned int num_threads)
+{
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (num_threads < 1) {
+                num_threads = 1;
+        } else if (num_threads > GC_MAX_THREADS) {
+                num_threads = GC_MAX_THREADS;
+        }
+
+        /*
+         * idle workers spin until marking is done, so threads
+         * without a cpu of their own only take time from the rest
+         */
+        if (cpus > 0 && num_threads > (unsigned long)cpus) {
+                num_threads = cpus;
+        }
+
+        /* the old threads might still be sweeping */
+        brd_gc_finish_sweep();
+
+        /* stop the old threads, if any */
+        brd_gc_run(BRD_GC_EXIT);
+        for (unsigned int i = 1; i < gc.num_threads; i++) {
+                pthread_join(gc.worker[i].thread, NULL);
+                pthread_mutex_destroy(&gc.worker[i].lock);
+                free(gc.worker[i].local.items);
+                free(gc.worker[i].shared.items);
+        }
+
+        gc.num_threads = num_threads;
+        for (unsigned int i = 1; i < gc.num_threads; i++) {
+                struct brd_gc_worker *w = &gc.worker[i];
+                brd_gc_stack_init(&w->local);
+                brd_gc_stack_init(&w->shared);
+                pthread_mutex_init(&w->lock, NULL);
+                w->survivors = NULL;
+                w->generation = gc.generation;
+                if (pthread_create(&w->thread, NULL, brd_gc_thread, w) != 0) {
+                        BARF("unable to start gc thread");
+                }
+        }
+}
+
+void
+brd_gc_destroy(void)
+{
+        brd_gc_set_threads(1);
+        free(gc.worker[0].local.items);
+        free(gc.worker[0].shared.items);
+        pthread_mutex_destroy(&gc.worker[0].lock);
+        pthread_mutex_destroy(&gc.lock);
+        pthread_mutex_destroy(&gc.sweep_lock);
+        pthread_cond_destroy(&gc.start);
+        pthread_cond_destroy(&gc.done);
+}
+
+void
+brd_gc_print_stats(FILE *file)
+{
+        fprintf(file, "gc: %zu collections, ", gc_stats.collections);
+        fprintf(file, "%.3fms total pause, ", gc_stats.total_pause * 1000);
+        fprintf(file, "%.3fms max pause\n", gc_stats.max_pause * 1000);
+        fprintf(file, "gc: %zu bytes allocated, ", gc_stats.bytes_allocated);
+        fprintf(file, "threshold %u\n", vm.threshold);
+        fprintf(file, "gc: live after the last collection:");
+        for (int i = 0; i < BRD_NUM_HEAP_TYPES; i++) {
+                fprintf(file, " %zu %s", gc_stats.live[i], brd_heap_type_string(i)->s);
+        }
+        fprintf(file, "\n");
+}
+
+static double
+brd_gc_seconds(struct timespec *start)
+{
+        struct timespec end;
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void
+brd_vm_gc(void)
+{
+        struct brd_gc_stack *roots = &gc.worker[0].local;
+        size_t num_roots;
+        struct timespec start;
+        double pause;
+
+        if (vm.heap_size < vm.threshold) {
+                return;
+        }
+#ifdef DEBUG
+        printf("GC starting... ");
+#endif
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        /* every entry in the heap is unmarked once the last sweep is done */
+        brd_gc_finish_sweep();
+        object_class.as.heap->marked = true;
+
+        /* mark values in the stack */
+        for (struct brd_value *p = vm.stack.values; p < vm.stack.sp; p++) {
+                brd_value_gc_mark(p, roots);
+        }
+
+        /* mark values held by variables */
+        for (size_t i = 0; i <= vm.fp; i++) {
+                brd_value_map_mark(&vm.frame[i].globals, roots);
+                brd_value_map_mark(&vm.frame[i].locals, roots);
+        }
+
+        /* hand the roots out evenly before the other threads start */
+        num_roots = roots->length;
+        roots->length = 0;
+        for (size_t i = 0; i < num_roots; i++) {
+                brd_gc_stack_push(
+                        &gc.worker[i % gc.num_threads].local,
+                        roots->items[i]
+                );
+        }
+
+        gc.idle = 0;
+        for (unsigned int i = 0; i < gc.num_threads; i++) {
+                memset(gc.worker[i].live, 0, sizeof(gc.worker[i].live));
+        }
+        brd_gc_run(BRD_GC_MARK);
+
+        /* everything that was traced survives the sweep */
+        vm.heap_size = 0;
+        memset(gc_stats.live, 0, sizeof(gc_stats.live));
+        for (unsigned int i = 0; i < gc.num_threads; i++) {
+                for (int j = 0; j < BRD_NUM_HEAP_TYPES; j++) {
+                        gc_stats.live[j] += gc.worker[i].live[j];
+                        vm.heap_size += gc.worker[i].live[j];
+                }
+        }
+
+        gc.unswept = vm.heap->next;
+        vm.heap->next = NULL;
+        if (gc.num_threads > 1) {
+                brd_gc_start(BRD_GC_SWEEP);
+                gc.sweeping = true;
+        }
+
+        /*
+         * Leave room for the heap to grow by half before the next collection,
+         * otherwise a live heap just under the threshold gets marked over and
+         * over again
+         */
+        if (vm.heap_size * GROW >= vm.threshold) {
+                vm.threshold = vm.heap_size * GROW;
+        } else if (vm.heap_size < INITIAL_THRESHOLD) {
+                vm.threshold = INITIAL_THRESHOLD;
+        }
+
+        pause = brd_gc_seconds(&start);
+        gc_stats.collections++;
+        gc_stats.total_pause += pause;
+        if (pause > gc_stats.max_pause) {
+                gc_stats.max_pause = pause;
+        }
+#ifdef DEBUG
+        printf("finished\n");
+#endif
+}
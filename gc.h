@@ -0,0 +1,37 @@
+#ifndef BRD_GC_H
+#define BRD_GC_H
+
+/* the gc never uses more threads than this */
+#define GC_MAX_THREADS 64
+
+/*
+ * A gray stack holds heap entries which have been marked,
+ * but whose children haven't been marked yet
+ */
+struct brd_gc_stack {
+        struct brd_heap_entry **items;
+        size_t length, capacity;
+};
+
+void brd_gc_stack_push(struct brd_gc_stack *stack, struct brd_heap_entry *entry);
+int brd_gc_try_mark(struct brd_heap_entry *entry);
+
+/* collector statistics, reported by @gcstats and --gc-stats */
+struct brd_gc_stats {
+        size_t collections;
+        size_t bytes_allocated; /* approximate, counted when allocated */
+        size_t live[BRD_NUM_HEAP_TYPES]; /* as of the last collection */
+        double total_pause, max_pause; /* in seconds */
+};
+
+extern struct brd_gc_stats gc_stats;
+
+void brd_gc_print_stats(FILE *file);
+
+void brd_gc_init(void);
+void brd_gc_destroy(void);
+void brd_gc_set_threads(unsigned int num_threads);
+void brd_gc_sweep_step(void);
+void brd_gc_finish_sweep(void);
+
+#endif
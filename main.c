@@ -2,8 +2,13 @@
 #include "ast.h"
 #include "value.h"
 #include "vm.h"
+#include "gc.h"
 #include "token.h"
 #include "parse.h"
+#include "opt.h"
+
+/* files are compiled with closure inlining unless --no-inline is given */
+static int inline_closures = true;
 
 /* reason the parser failed (used for repl */
 enum brd_compiler_status {
@@ -55,6 +60,7 @@ brd_parse_and_compile_repl(char *code)
                 return BRD_REPL_PARSER;
         }
 
+        program = brd_node_fold(program);
         brd_node_compile(program);
         brd_node_destroy(program);
 
@@ -142,6 +148,10 @@ brd_parse_and_compile(char *code)
                 exit(EXIT_FAILURE);
         }
 
+        if (inline_closures) {
+                program = brd_node_inline_calls(program);
+        }
+        program = brd_node_fold(program);
         brd_node_compile(program);
         brd_node_destroy(program);
 }
@@ -167,6 +177,9 @@ const char *help =
         "\n"
         "    bread                    Run the bread REPL\n"
         "    bread --help             Print this message and exit\n"
+        "    bread --gc-threads N ... Mark and sweep the heap using N threads (at most one per cpu)\n"
+        "    bread --gc-stats ...     Print garbage collector statistics at exit\n"
+        "    bread --no-inline ...    Don't inline calls to small closures\n"
         "    bread [ file ... ]       Run the given files\n"
         "    bread [ file ... ] -     Run the given files, then start a REPL\n"
         "\n"
@@ -175,6 +188,8 @@ const char *help =
 int
 main(int argc, char **argv)
 {
+        int gc_stats_at_exit = false;
+
         brd_vm_init();
         if (argc == 1) {
                 brd_repl();
@@ -185,10 +200,22 @@ main(int argc, char **argv)
                                 break;
                         } else if (strcmp(argv[i], "--help") == 0) {
                                 printf("%s", help);
+                        } else if (strcmp(argv[i], "--gc-threads") == 0) {
+                                if (++i == argc) {
+                                        BARF("--gc-threads expects a number");
+                                }
+                                brd_gc_set_threads(strtoul(argv[i], NULL, 10));
+                        } else if (strcmp(argv[i], "--gc-stats") == 0) {
+                                gc_stats_at_exit = true;
+                        } else if (strcmp(argv[i], "--no-inline") == 0) {
+                                inline_closures = false;
                         } else {
                                 brd_run_file(argv[i]);
                         }
                 }
         }
+        if (gc_stats_at_exit) {
+                brd_gc_print_stats(stderr);
+        }
         brd_vm_destroy();
 }
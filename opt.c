@@ -0,0 +1,800 @@
+#include "common.h"
+#include "ast.h"
+#include "value.h"
+#include "opt.h"
+
+#define AS(type, x) ((struct brd_node_ ## type *)(x))
+
+/* the vm's % goes through long long, which is only defined for these */
+#define MOD_LIMIT 0x1p63L
+
+static void
+brd_node_map_arglist(struct brd_node_arglist *args, brd_node_fn2 fn)
+{
+        for (size_t i = 0; i < args->num_args; i++) {
+                args->args[i] = fn(args->args[i]);
+        }
+}
+
+/* replace each child c of node with fn(c) */
+static void
+brd_node_map_children(struct brd_node *node, brd_node_fn2 fn)
+{
+        switch (node->ntype) {
+        case BRD_NODE_ASSIGN:
+                AS(assign, node)->l = fn(AS(assign, node)->l);
+                AS(assign, node)->r = fn(AS(assign, node)->r);
+                break;
+        case BRD_NODE_BINOP:
+                AS(binop, node)->l = fn(AS(binop, node)->l);
+                AS(binop, node)->r = fn(AS(binop, node)->r);
+                break;
+        case BRD_NODE_UNARY:
+                AS(unary, node)->u = fn(AS(unary, node)->u);
+                break;
+        case BRD_NODE_VAR:
+        case BRD_NODE_NUM_LIT:
+        case BRD_NODE_STRING_LIT:
+        case BRD_NODE_BOOL_LIT:
+        case BRD_NODE_UNIT_LIT:
+        case BRD_NODE_BUILTIN:
+                break;
+        case BRD_NODE_LIST_LIT:
+                brd_node_map_arglist(AS(list_lit, node)->items, fn);
+                break;
+        case BRD_NODE_FUNCALL:
+                AS(funcall, node)->fn = fn(AS(funcall, node)->fn);
+                brd_node_map_arglist(AS(funcall, node)->args, fn);
+                break;
+        case BRD_NODE_CLOSURE:
+                AS(closure, node)->body = fn(AS(closure, node)->body);
+                break;
+        case BRD_NODE_BODY:
+                for (size_t i = 0; i < AS(body, node)->num_stmts; i++) {
+                        AS(body, node)->stmts[i] = fn(AS(body, node)->stmts[i]);
+                }
+                break;
+        case BRD_NODE_IFEXPR:
+                AS(ifexpr, node)->cond = fn(AS(ifexpr, node)->cond);
+                AS(ifexpr, node)->body = fn(AS(ifexpr, node)->body);
+                for (size_t i = 0; i < AS(ifexpr, node)->num_elifs; i++) {
+                        AS(ifexpr, node)->elifs[i].cond = fn(AS(ifexpr, node)->elifs[i].cond);
+                        AS(ifexpr, node)->elifs[i].body = fn(AS(ifexpr, node)->elifs[i].body);
+                }
+                if (AS(ifexpr, node)->els != NULL) {
+                        AS(ifexpr, node)->els = fn(AS(ifexpr, node)->els);
+                }
+                break;
+        case BRD_NODE_INDEX:
+                AS(index, node)->list = fn(AS(index, node)->list);
+                AS(index, node)->idx = fn(AS(index, node)->idx);
+                break;
+        case BRD_NODE_WHILE:
+                AS(while, node)->cond = fn(AS(while, node)->cond);
+                AS(while, node)->body = fn(AS(while, node)->body);
+                if (AS(while, node)->inc != NULL) {
+                        AS(while, node)->inc = fn(AS(while, node)->inc);
+                }
+                break;
+        case BRD_NODE_FIELD:
+                AS(field, node)->object = fn(AS(field, node)->object);
+                break;
+        case BRD_NODE_ACC_OBJ:
+                AS(acc_obj, node)->object = fn(AS(acc_obj, node)->object);
+                break;
+        case BRD_NODE_SUBCLASS:
+                AS(subclass, node)->super = fn(AS(subclass, node)->super);
+                AS(subclass, node)->constructor = fn(AS(subclass, node)->constructor);
+                for (size_t i = 0; i < AS(subclass, node)->num_decs; i++) {
+                        AS(subclass, node)->decs[i].expression =
+                                fn(AS(subclass, node)->decs[i].expression);
+                }
+                break;
+        case BRD_NODE_DICT:
+                for (size_t i = 0; i < AS(dict, node)->num_pairs; i++) {
+                        AS(dict, node)->pairs[i].value = fn(AS(dict, node)->pairs[i].value);
+                }
+                break;
+        case BRD_NODE_FOR_IN:
+                AS(for_in, node)->iter = fn(AS(for_in, node)->iter);
+                AS(for_in, node)->body = fn(AS(for_in, node)->body);
+                break;
+        case BRD_NODE_INLINE:
+                AS(inline, node)->body = fn(AS(inline, node)->body);
+                break;
+        case BRD_NODE_PROGRAM:
+                for (size_t i = 0; i < AS(program, node)->num_stmts; i++) {
+                        AS(program, node)->stmts[i] = fn(AS(program, node)->stmts[i]);
+                }
+                break;
+        }
+}
+
+/* replace node with a new one on the same line */
+static struct brd_node *
+brd_node_replace(struct brd_node *node, struct brd_node *new)
+{
+        new->line_number = node->line_number;
+        brd_node_destroy(node);
+        return new;
+}
+
+/* destroy node, except for the child which takes its place */
+static struct brd_node *
+brd_node_take(struct brd_node *node, struct brd_node **child)
+{
+        struct brd_node *taken = *child;
+
+        *child = brd_node_unit_lit_new();
+        brd_node_destroy(node);
+        return taken;
+}
+
+/* the value of a literal, a string literal's value points into string */
+static int
+brd_node_literal(
+        struct brd_node *node,
+        struct brd_value *value,
+        struct brd_value_string *string)
+{
+        switch (node->ntype) {
+        case BRD_NODE_NUM_LIT:
+                value->vtype = BRD_VAL_NUM;
+                value->as.num = AS(num_lit, node)->v;
+                return true;
+        case BRD_NODE_STRING_LIT:
+                brd_value_string_init(string, AS(string_lit, node)->s);
+                value->vtype = BRD_VAL_STRING;
+                value->as.string = string;
+                return true;
+        case BRD_NODE_BOOL_LIT:
+                value->vtype = BRD_VAL_BOOL;
+                value->as.boolean = AS(bool_lit, node)->b;
+                return true;
+        case BRD_NODE_UNIT_LIT:
+                value->vtype = BRD_VAL_UNIT;
+                return true;
+        default:
+                return false;
+        }
+}
+
+static int
+brd_node_is_num_lit(struct brd_node *node, long double v)
+{
+        return node->ntype == BRD_NODE_NUM_LIT
+                && AS(num_lit, node)->v == v
+                && !signbit(AS(num_lit, node)->v);
+}
+
+/* whether the node always evaluates to a number */
+static int
+brd_node_is_num(struct brd_node *node)
+{
+        switch (node->ntype) {
+        case BRD_NODE_NUM_LIT:
+                return true;
+        case BRD_NODE_UNARY:
+                return AS(unary, node)->utype == BRD_NEGATE;
+        case BRD_NODE_BINOP:
+                switch (AS(binop, node)->btype) {
+                case BRD_PLUS:
+                case BRD_MINUS:
+                case BRD_MUL:
+                case BRD_DIV:
+                case BRD_IDIV:
+                case BRD_MOD:
+                case BRD_POW:
+                        return true;
+                default:
+                        return false;
+                }
+        default:
+                return false;
+        }
+}
+
+/* x * 1, 1 * x, x / 1 and x - 0 are x, as long as x is already a number */
+static struct brd_node *
+brd_node_simplify_binop(struct brd_node *node)
+{
+        struct brd_node_binop *b = AS(binop, node);
+
+        switch (b->btype) {
+        case BRD_MUL:
+                if (brd_node_is_num_lit(b->l, 1) && brd_node_is_num(b->r)) {
+                        return brd_node_take(node, &b->r);
+                }
+                if (brd_node_is_num_lit(b->r, 1) && brd_node_is_num(b->l)) {
+                        return brd_node_take(node, &b->l);
+                }
+                break;
+        case BRD_DIV:
+                if (brd_node_is_num_lit(b->r, 1) && brd_node_is_num(b->l)) {
+                        return brd_node_take(node, &b->l);
+                }
+                break;
+        case BRD_MINUS:
+                if (brd_node_is_num_lit(b->r, 0) && brd_node_is_num(b->l)) {
+                        return brd_node_take(node, &b->l);
+                }
+                break;
+        default:
+                break;
+        }
+        return node;
+}
+
+/* like brd_value_concat, literals never need an allocation to become strings */
+static struct brd_node *
+brd_node_fold_concat(struct brd_value *a, struct brd_value *b)
+{
+        struct brd_node *node;
+        size_t length_a, length_b;
+        char *s;
+
+        brd_value_coerce_string(a);
+        brd_value_coerce_string(b);
+        length_a = STRING_LENGTH(*a);
+        length_b = STRING_LENGTH(*b);
+
+        s = malloc(length_a + length_b + 1);
+        memcpy(s, STRING_CHARS(*a), length_a);
+        memcpy(s + length_a, STRING_CHARS(*b), length_b);
+        s[length_a + length_b] = '\0';
+        node = brd_node_string_lit_new(s);
+        free(s);
+
+        return node;
+}
+
+static struct brd_node *
+brd_node_fold_binop(struct brd_node *node)
+{
+        struct brd_node_binop *b = AS(binop, node);
+        struct brd_value l, r;
+        struct brd_value_string ls, rs;
+        struct brd_comparison cmp;
+        int l_lit, r_lit;
+
+        brd_node_map_children(node, brd_node_fold);
+        l_lit = brd_node_literal(b->l, &l, &ls);
+        r_lit = brd_node_literal(b->r, &r, &rs);
+
+        /* and/or only need to know their left side */
+        if (l_lit && (b->btype == BRD_AND || b->btype == BRD_OR)) {
+                if (brd_value_truthify(&l) == (b->btype == BRD_AND)) {
+                        return brd_node_take(node, &b->r);
+                }
+                return brd_node_take(node, &b->l);
+        }
+        if (!l_lit || !r_lit) {
+                return brd_node_simplify_binop(node);
+        }
+
+        switch (b->btype) {
+        case BRD_PLUS:
+        case BRD_MINUS:
+        case BRD_MUL:
+        case BRD_DIV:
+        case BRD_IDIV:
+        case BRD_MOD:
+        case BRD_POW:
+                brd_value_coerce_num(&l);
+                brd_value_coerce_num(&r);
+                switch (b->btype) {
+                case BRD_PLUS: l.as.num += r.as.num; break;
+                case BRD_MINUS: l.as.num -= r.as.num; break;
+                case BRD_MUL: l.as.num *= r.as.num; break;
+                case BRD_DIV: l.as.num /= r.as.num; break;
+                case BRD_IDIV: l.as.num = floorl(l.as.num / r.as.num); break;
+                case BRD_MOD:
+                        /* leave it to fail at runtime, if it's ever run */
+                        if (!(fabsl(l.as.num) < MOD_LIMIT)
+                                        || !(fabsl(r.as.num) < MOD_LIMIT)
+                                        || (long long int) r.as.num == 0) {
+                                return node;
+                        }
+                        l.as.num = (long long int) l.as.num
+                                % (long long int) r.as.num;
+                        break;
+                case BRD_POW: l.as.num = powl(l.as.num, r.as.num); break;
+                default: break;
+                }
+                return brd_node_replace(node, brd_node_num_lit_new(l.as.num));
+        case BRD_CONCAT:
+                return brd_node_replace(node, brd_node_fold_concat(&l, &r));
+        case BRD_LT:
+        case BRD_LEQ:
+        case BRD_GT:
+        case BRD_GEQ:
+                cmp = brd_value_compare(&l, &r);
+                switch (b->btype) {
+                case BRD_LT: brd_comparison_ord(cmp, <, l.as.boolean); break;
+                case BRD_LEQ: brd_comparison_ord(cmp, <=, l.as.boolean); break;
+                case BRD_GT: brd_comparison_ord(cmp, >, l.as.boolean); break;
+                case BRD_GEQ: brd_comparison_ord(cmp, >=, l.as.boolean); break;
+                default: break;
+                }
+                return brd_node_replace(node, brd_node_bool_lit_new(l.as.boolean));
+        case BRD_EQ:
+                return brd_node_replace(
+                        node,
+                        brd_node_bool_lit_new(brd_value_equals(&l, &r))
+                );
+        default:
+                return node;
+        }
+}
+
+static struct brd_node *
+brd_node_fold_unary(struct brd_node *node)
+{
+        struct brd_node_unary *u = AS(unary, node);
+        struct brd_value value;
+        struct brd_value_string string;
+
+        brd_node_map_children(node, brd_node_fold);
+        if (!brd_node_literal(u->u, &value, &string)) {
+                /* - - x is x, as long as x is already a number */
+                if (u->utype == BRD_NEGATE
+                                && u->u->ntype == BRD_NODE_UNARY
+                                && AS(unary, u->u)->utype == BRD_NEGATE
+                                && brd_node_is_num(AS(unary, u->u)->u)) {
+                        return brd_node_take(node, &AS(unary, u->u)->u);
+                }
+                return node;
+        }
+
+        switch (u->utype) {
+        case BRD_NEGATE:
+                brd_value_coerce_num(&value);
+                value.as.num *= -1;
+                return brd_node_replace(node, brd_node_num_lit_new(value.as.num));
+        case BRD_NOT:
+                return brd_node_replace(
+                        node,
+                        brd_node_bool_lit_new(!brd_value_truthify(&value))
+                );
+        }
+        return node;
+}
+
+static struct brd_node *
+brd_node_fold_ifexpr(struct brd_node *node)
+{
+        struct brd_node_ifexpr *e = AS(ifexpr, node);
+        struct brd_value value;
+        struct brd_value_string string;
+        size_t kept = 0;
+
+        brd_node_map_children(node, brd_node_fold);
+
+        /*
+         * drop the elifs which are never taken, an elif which is always
+         * taken becomes the else and everything after it is dropped
+         */
+        for (size_t i = 0; i < e->num_elifs; i++) {
+                if (!brd_node_literal(e->elifs[i].cond, &value, &string)) {
+                        e->elifs[kept++] = e->elifs[i];
+                        continue;
+                }
+                brd_node_destroy(e->elifs[i].cond);
+                if (!brd_value_truthify(&value)) {
+                        brd_node_destroy(e->elifs[i].body);
+                        continue;
+                }
+                if (e->els != NULL) {
+                        brd_node_destroy(e->els);
+                }
+                e->els = e->elifs[i].body;
+                for (size_t j = i + 1; j < e->num_elifs; j++) {
+                        brd_node_destroy(e->elifs[j].cond);
+                        brd_node_destroy(e->elifs[j].body);
+                }
+                break;
+        }
+        e->num_elifs = kept;
+
+        if (!brd_node_literal(e->cond, &value, &string)) {
+                return node;
+        } else if (brd_value_truthify(&value)) {
+                return brd_node_take(node, &e->body);
+        } else if (e->num_elifs > 0) {
+                /* the first elif takes the place of the if */
+                brd_node_destroy(e->cond);
+                brd_node_destroy(e->body);
+                e->cond = e->elifs[0].cond;
+                e->body = e->elifs[0].body;
+                e->num_elifs--;
+                memmove(e->elifs, e->elifs + 1, sizeof(*e->elifs) * e->num_elifs);
+                return node;
+        } else if (e->els != NULL) {
+                return brd_node_take(node, &e->els);
+        } else {
+                return brd_node_replace(node, brd_node_unit_lit_new());
+        }
+}
+
+struct brd_node *
+brd_node_fold(struct brd_node *node)
+{
+        switch (node->ntype) {
+        case BRD_NODE_BINOP:
+                return brd_node_fold_binop(node);
+        case BRD_NODE_UNARY:
+                return brd_node_fold_unary(node);
+        case BRD_NODE_IFEXPR:
+                return brd_node_fold_ifexpr(node);
+        default:
+                brd_node_map_children(node, brd_node_fold);
+                return node;
+        }
+}
+
+/*
+ * Inlining
+ *
+ * A closure is inlined when it's bound by a top level set which is the only
+ * assignment to its name, and its body only reads its own arguments.
+ * A call is inlined when it's in the top level code after that set, or in a
+ * closure created there, since a closure only sees the variables of the
+ * frame that created it as they were when it was created.
+ *
+ * Arguments which are variables or literals are substituted into the body,
+ * the rest are evaluated into temporaries first, so that every argument is
+ * still evaluated once and in order. Temporaries are named with a %, which
+ * can't appear in a variable name in the source, and are unset once the
+ * body has run so they don't keep the arguments alive.
+ */
+
+/* closures whose bodies have at most this many nodes are inlined */
+#define INLINE_MAX_NODES 24
+
+/* room for a temporary's name */
+#define TEMP_NAME_SIZE 64
+
+struct brd_inline_def {
+        char *id;
+        struct brd_node_closure *closure;
+};
+
+static struct {
+        /* how many times each variable is assigned to in the program */
+        struct brd_value_map assigned;
+        char **names;
+        size_t num_names, names_capacity;
+
+        struct brd_inline_def *defs;
+        size_t num_defs, defs_capacity;
+
+        /* the closure created at the top level that's being walked, if any */
+        struct brd_node_closure *scope;
+
+        /* the closure whose body is being measured or copied */
+        struct brd_node_closure *closure;
+        struct brd_node **args;
+        size_t site, size;
+        int ok;
+        char _p[4];
+} inliner;
+
+/* counts the temporaries and call sites in every program */
+static size_t inline_temps, inline_sites;
+
+static void
+brd_inliner_count(char *id)
+{
+        struct brd_value *count = brd_value_map_get(&inliner.assigned, id);
+        struct brd_value one;
+
+        if (count != NULL) {
+                count->as.num++;
+                return;
+        }
+
+        if (inliner.num_names == inliner.names_capacity) {
+                inliner.names_capacity = inliner.names_capacity * 2 + 8;
+                inliner.names = realloc(
+                        inliner.names,
+                        sizeof(*inliner.names) * inliner.names_capacity
+                );
+        }
+        inliner.names[inliner.num_names] = strdup(id);
+        one.vtype = BRD_VAL_NUM;
+        one.as.num = 1;
+        brd_value_map_set(&inliner.assigned, inliner.names[inliner.num_names++], &one);
+}
+
+static struct brd_node *
+brd_inliner_count_assignments(struct brd_node *node)
+{
+        if (node->ntype == BRD_NODE_ASSIGN && AS(assign, node)->l->ntype == BRD_NODE_VAR) {
+                brd_inliner_count(AS(var, AS(assign, node)->l)->id);
+        } else if (node->ntype == BRD_NODE_FOR_IN) {
+                brd_inliner_count(AS(for_in, node)->var);
+        }
+        brd_node_map_children(node, brd_inliner_count_assignments);
+        return node;
+}
+
+static int
+brd_inliner_is_arg(struct brd_node_closure *closure, char *id)
+{
+        for (size_t i = 0; i < closure->num_args; i++) {
+                if (strcmp(closure->args[i], id) == 0) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static int
+brd_inliner_is_temp(char *id)
+{
+        return id[0] == '%';
+}
+
+/*
+ * Check that the body only reads the closure's arguments, doesn't assign
+ * anything but temporaries, and doesn't create closures, which would capture
+ * the caller's variables instead of the callee's
+ */
+static struct brd_node *
+brd_inliner_measure(struct brd_node *node)
+{
+        inliner.size++;
+        switch (node->ntype) {
+        case BRD_NODE_VAR:
+                if (!brd_inliner_is_arg(inliner.closure, AS(var, node)->id)
+                                && !brd_inliner_is_temp(AS(var, node)->id)) {
+                        inliner.ok = false;
+                }
+                break;
+        case BRD_NODE_ASSIGN:
+                if (AS(assign, node)->l->ntype != BRD_NODE_VAR
+                                || !brd_inliner_is_temp(AS(var, AS(assign, node)->l)->id)) {
+                        inliner.ok = false;
+                }
+                break;
+        case BRD_NODE_CLOSURE:
+        case BRD_NODE_SUBCLASS:
+        case BRD_NODE_WHILE:
+        case BRD_NODE_FOR_IN:
+        case BRD_NODE_PROGRAM:
+                inliner.ok = false;
+                return node;
+        default:
+                break;
+        }
+        brd_node_map_children(node, brd_inliner_measure);
+        return node;
+}
+
+static int
+brd_inliner_inlinable(struct brd_node_closure *closure)
+{
+        inliner.closure = closure;
+        inliner.size = 0;
+        inliner.ok = true;
+        brd_inliner_measure(closure->body);
+        return inliner.ok && inliner.size <= INLINE_MAX_NODES;
+}
+
+/* replace the arguments in a copy of a closure's body */
+static struct brd_node *
+brd_inliner_substitute(struct brd_node *node)
+{
+        char name[TEMP_NAME_SIZE];
+        char *id;
+
+        if (node->ntype == BRD_NODE_INLINE) {
+                for (size_t i = 0; i < AS(inline, node)->num_temps; i++) {
+                        id = AS(inline, node)->temps[i];
+                        snprintf(name, sizeof(name), "%s.%zu", id, inliner.site);
+                        free(id);
+                        AS(inline, node)->temps[i] = strdup(name);
+                }
+        }
+        if (node->ntype != BRD_NODE_VAR) {
+                brd_node_map_children(node, brd_inliner_substitute);
+                return node;
+        }
+
+        id = AS(var, node)->id;
+        if (brd_inliner_is_temp(id)) {
+                /* each copy gets its own temporaries */
+                snprintf(name, sizeof(name), "%s.%zu", id, inliner.site);
+                return brd_node_replace(node, brd_node_var_new(name));
+        }
+        for (size_t i = 0; i < inliner.closure->num_args; i++) {
+                if (strcmp(inliner.closure->args[i], id) == 0) {
+                        return brd_node_replace(node, brd_node_copy(inliner.args[i]));
+                }
+        }
+        return node;
+}
+
+static int
+brd_inliner_is_simple(struct brd_node *node)
+{
+        switch (node->ntype) {
+        case BRD_NODE_VAR:
+        case BRD_NODE_NUM_LIT:
+        case BRD_NODE_STRING_LIT:
+        case BRD_NODE_BOOL_LIT:
+        case BRD_NODE_UNIT_LIT:
+                return true;
+        default:
+                return false;
+        }
+}
+
+static struct brd_node *
+brd_inliner_expand(struct brd_node *node, struct brd_node_closure *closure)
+{
+        struct brd_node_arglist *args = AS(funcall, node)->args;
+        struct brd_node **stmts, **subst;
+        struct brd_node *body;
+        size_t num_stmts = 0, complex_end = 0;
+        char name[TEMP_NAME_SIZE];
+        char **temps;
+
+        stmts = malloc(sizeof(*stmts) * (args->num_args + 1));
+        subst = malloc(sizeof(*subst) * args->num_args);
+        temps = malloc(sizeof(*temps) * args->num_args);
+
+        /* one past the last argument which has to be evaluated into a temporary */
+        for (size_t i = 0; i < args->num_args; i++) {
+                if (!brd_inliner_is_simple(args->args[i])) {
+                        complex_end = i + 1;
+                }
+        }
+
+        /*
+         * a variable can only be read late if none of the arguments after
+         * it, which may assign to it, need to be evaluated first
+         */
+        for (size_t i = 0; i < args->num_args; i++) {
+                struct brd_node *arg = args->args[i];
+
+                if (brd_inliner_is_simple(arg)
+                                && (arg->ntype != BRD_NODE_VAR || i + 1 >= complex_end)) {
+                        subst[i] = brd_node_copy(arg);
+                        continue;
+                }
+                snprintf(name, sizeof(name), "%%%zu", inline_temps++);
+                stmts[num_stmts++] = brd_node_assign_new(
+                        brd_node_var_new(name),
+                        brd_node_copy(arg)
+                );
+                subst[i] = brd_node_var_new(name);
+                temps[num_stmts - 1] = strdup(name);
+        }
+
+        inliner.closure = closure;
+        inliner.args = subst;
+        inliner.site = inline_sites++;
+        stmts[num_stmts++] = brd_inliner_substitute(brd_node_copy(closure->body));
+
+        for (size_t i = 0; i < args->num_args; i++) {
+                brd_node_destroy(subst[i]);
+        }
+        free(subst);
+
+        body = brd_node_body_new(stmts, num_stmts);
+        body->line_number = node->line_number;
+        return brd_node_replace(node, brd_node_inline_new(body, temps, num_stmts - 1));
+}
+
+static struct brd_node_closure *
+brd_inliner_lookup(struct brd_node *fn, size_t num_args)
+{
+        if (fn->ntype != BRD_NODE_VAR) {
+                return NULL;
+        } else if (inliner.scope != NULL
+                        && brd_inliner_is_arg(inliner.scope, AS(var, fn)->id)) {
+                return NULL;
+        }
+
+        for (size_t i = 0; i < inliner.num_defs; i++) {
+                if (strcmp(inliner.defs[i].id, AS(var, fn)->id) == 0) {
+                        if (inliner.defs[i].closure->num_args != num_args) {
+                                return NULL;
+                        }
+                        return inliner.defs[i].closure;
+                }
+        }
+        return NULL;
+}
+
+static struct brd_node *
+brd_inliner_walk(struct brd_node *node)
+{
+        struct brd_node_closure *closure;
+
+        if (node->ntype == BRD_NODE_CLOSURE) {
+                /* nested closures can't see the top level variables */
+                if (inliner.scope == NULL) {
+                        inliner.scope = AS(closure, node);
+                        brd_node_map_children(node, brd_inliner_walk);
+                        inliner.scope = NULL;
+                }
+                return node;
+        }
+
+        brd_node_map_children(node, brd_inliner_walk);
+        if (node->ntype == BRD_NODE_FUNCALL) {
+                closure = brd_inliner_lookup(
+                        AS(funcall, node)->fn,
+                        AS(funcall, node)->args->num_args
+                );
+                if (closure != NULL) {
+                        return brd_inliner_expand(node, closure);
+                }
+        }
+        return node;
+}
+
+/* add the closure if the statement is the set which binds it */
+static void
+brd_inliner_add_def(struct brd_node *stmt)
+{
+        struct brd_node *l, *r;
+        char *id;
+        struct brd_value *count;
+
+        if (stmt->ntype != BRD_NODE_ASSIGN) {
+                return;
+        }
+        l = AS(assign, stmt)->l;
+        r = AS(assign, stmt)->r;
+        if (l->ntype != BRD_NODE_VAR || r->ntype != BRD_NODE_CLOSURE) {
+                return;
+        }
+
+        /* self and this are set by the vm when a closure is called */
+        id = AS(var, l)->id;
+        count = brd_value_map_get(&inliner.assigned, id);
+        if (count->as.num != 1 || strcmp(id, "self") == 0 || strcmp(id, "this") == 0) {
+                return;
+        } else if (!brd_inliner_inlinable(AS(closure, r))) {
+                return;
+        }
+
+        if (inliner.num_defs == inliner.defs_capacity) {
+                inliner.defs_capacity = inliner.defs_capacity * 2 + 8;
+                inliner.defs = realloc(
+                        inliner.defs,
+                        sizeof(*inliner.defs) * inliner.defs_capacity
+                );
+        }
+        inliner.defs[inliner.num_defs].id = id;
+        inliner.defs[inliner.num_defs].closure = AS(closure, r);
+        inliner.num_defs++;
+}
+
+struct brd_node *
+brd_node_inline_calls(struct brd_node *program)
+{
+        struct brd_node_program *p = AS(program, program);
+
+        brd_value_map_init(&inliner.assigned);
+        brd_inliner_count_assignments(program);
+
+        /* closures are inlined into the ones after them before being measured */
+        for (size_t i = 0; i < p->num_stmts; i++) {
+                p->stmts[i] = brd_inliner_walk(p->stmts[i]);
+                brd_inliner_add_def(p->stmts[i]);
+        }
+
+        brd_value_map_destroy(&inliner.assigned);
+        for (size_t i = 0; i < inliner.num_names; i++) {
+                free(inliner.names[i]);
+        }
+        free(inliner.names);
+        free(inliner.defs);
+        memset(&inliner, 0, sizeof(inliner));
+
+        return program;
+}
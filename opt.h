@@ -0,0 +1,22 @@
+#ifndef BRD_OPT_H
+#define BRD_OPT_H
+
+/*
+ * Passes over the ast which run between parsing and compiling.
+ * Each one takes ownership of the node it's given and returns
+ * the node which should be used in its place.
+ */
+
+/*
+ * Evaluate operators whose operands are all literals, using the same
+ * coercions as the vm, and drop if/elif branches which can never run
+ */
+struct brd_node *brd_node_fold(struct brd_node *node);
+
+/*
+ * Replace calls to small closures which are bound once at the top level
+ * with the closure's body, this only works on a whole program
+ */
+struct brd_node *brd_node_inline_calls(struct brd_node *program);
+
+#endif
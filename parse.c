@@ -907,6 +907,36 @@ brd_parse_while(struct brd_token_list *tokens)
         return brd_node_while_new(no_list, cond, body, NULL);
 }
 
+struct brd_node *
+brd_parse_for_in(struct brd_token_list *tokens, char *var, int no_list, int skip_copy)
+{
+        /* the in token has already been consumed */
+        struct brd_node *iter, *body;
+
+        iter = brd_parse_expression(tokens);
+        if (iter == NULL) {
+                return NULL;
+        } else if (brd_token_list_pop_token(tokens) != BRD_TOK_DO) {
+                error_message = "expected a do token";
+                brd_node_destroy(iter);
+                return NULL;
+        }
+
+        skip_newlines = skip_copy;
+        body = brd_parse_body(tokens);
+        if (body == NULL) {
+                brd_node_destroy(iter);
+                return NULL;
+        } else if (brd_token_list_pop_token(tokens) != BRD_TOK_END) {
+                error_message = "expected an end token";
+                brd_node_destroy(iter);
+                brd_node_destroy(body);
+                return NULL;
+        }
+
+        return brd_node_for_in_new(no_list, var, iter, body);
+}
+
 struct brd_node *
 brd_parse_for(struct brd_token_list *tokens)
 {
@@ -928,7 +958,10 @@ brd_parse_for(struct brd_token_list *tokens)
                 return NULL;
         }
         var = brd_token_list_pop_string(tokens);
-        if (brd_token_list_pop_token(tokens) != BRD_TOK_EQ) {
+        if (brd_token_list_peek(tokens) == BRD_TOK_IN) {
+                brd_token_list_pop_token(tokens);
+                return brd_parse_for_in(tokens, var, no_list, skip_copy);
+        } else if (brd_token_list_pop_token(tokens) != BRD_TOK_EQ) {
                 error_message = "expected an \"=\"";
                 return NULL;
         }
@@ -24,6 +24,7 @@ struct brd_node *brd_parse_ifexpr(struct brd_token_list *tokens);
 int brd_parse_elif(struct brd_token_list *tokens, struct brd_node_elif *e);
 struct brd_node *brd_parse_while(struct brd_token_list *tokens);
 struct brd_node *brd_parse_for(struct brd_token_list *tokens);
+struct brd_node *brd_parse_for_in(struct brd_token_list *tokens, char *var, int no_list, int skip_copy);
 struct brd_node *brd_parse_subclass(struct brd_token_list *tokens);
 struct brd_node *brd_parse_dict(struct brd_token_list *tokens);
 
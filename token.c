@@ -249,6 +249,8 @@ brd_token_list_tokenize(struct brd_token_list *list, char *string)
                                 brd_token_list_add_token(list, BRD_TOK_THEN);
                         } else if (strcmp(buffer, "for") == 0) {
                                 brd_token_list_add_token(list, BRD_TOK_FOR);
+                        } else if (strcmp(buffer, "in") == 0) {
+                                brd_token_list_add_token(list, BRD_TOK_IN);
                         } else if (strcmp(buffer, "while") == 0) {
                                 brd_token_list_add_token(list, BRD_TOK_WHILE);
                         } else if (strcmp(buffer, "do") == 0) {
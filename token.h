@@ -63,6 +63,7 @@ enum brd_token {
         BRD_TOK_FUNC,
 
         BRD_TOK_FOR,
+        BRD_TOK_IN,
         BRD_TOK_WHILE,
         BRD_TOK_DO,
 
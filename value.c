@@ -1,5 +1,9 @@
 #include "common.h"
+#include "ast.h"
 #include "value.h"
+#include "vm.h"
+#include "gc.h"
+#include "array.h"
 
 /* http://www.cse.yorku.ca/~oz/hash.html djb2 hash algorithm */
 static unsigned long
@@ -15,32 +19,297 @@ hash(char *str)
         return hash;
 }
 
+static struct brd_value_list_buffer *
+brd_value_list_buffer_new(size_t size)
+{
+        struct brd_value_list_buffer *buffer = malloc(sizeof(*buffer) + size);
+
+        buffer->refs = 1;
+        buffer->size = size;
+        return buffer;
+}
+
+/* lists are destroyed by the gc's sweepers too, so refs is changed atomically */
+static void
+brd_value_list_buffer_release(struct brd_value_list_buffer *buffer)
+{
+        if (__atomic_sub_fetch(&buffer->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+                free(buffer);
+        }
+}
+
+static size_t
+brd_value_list_item_size(struct brd_value_list *list)
+{
+        return list->kind == BRD_LIST_NUMS ? sizeof(long double) : sizeof(struct brd_value);
+}
+
+/* where the first item is in the buffer */
+static unsigned char *
+brd_value_list_start(struct brd_value_list *list)
+{
+        return list->kind == BRD_LIST_NUMS
+                ? (unsigned char *)list->as.nums
+                : (unsigned char *)list->as.values;
+}
+
+static void
+brd_value_list_set_start(struct brd_value_list *list, unsigned char *start)
+{
+        if (list->kind == BRD_LIST_NUMS) {
+                list->as.nums = (long double *)(void *)start;
+        } else {
+                list->as.values = (struct brd_value *)(void *)start;
+        }
+}
+
 static void
-brd_value_list_init_with_capacity(struct brd_value_list *list, size_t capacity)
+brd_value_list_init_with_capacity(
+        struct brd_value_list *list,
+        enum brd_list_kind kind,
+        size_t capacity)
 {
-        list->capacity = capacity;
+        list->kind = kind;
+        list->buffer = brd_value_list_buffer_new(
+                capacity * brd_value_list_item_size(list)
+        );
+        brd_value_list_set_start(list, list->buffer->data);
         list->length = 0;
-        list->items = malloc(sizeof(struct brd_value) * list->capacity);
 }
 
+/* lists start out holding numbers */
 void
 brd_value_list_init(struct brd_value_list *list)
 {
-        brd_value_list_init_with_capacity(list, 4);
+        brd_value_list_init_with_capacity(list, BRD_LIST_NUMS, 4);
+}
+
+void
+brd_value_list_destroy(struct brd_value_list *list)
+{
+        brd_value_list_buffer_release(list->buffer);
+}
+
+struct brd_value
+brd_value_list_get(struct brd_value_list *list, size_t idx)
+{
+        struct brd_value value;
+
+        if (list->kind == BRD_LIST_VALUES) {
+                return list->as.values[idx];
+        }
+        value.vtype = BRD_VAL_NUM;
+        value.as.num = list->as.nums[idx];
+        return value;
+}
+
+/*
+ * Move the items into a buffer of their own, leaving room for
+ * front items before them and back items after them
+ */
+static void
+brd_value_list_rebuffer(struct brd_value_list *list, size_t front, size_t back)
+{
+        struct brd_value_list_buffer *buffer;
+        size_t item_size = brd_value_list_item_size(list);
+
+        buffer = brd_value_list_buffer_new((front + list->length + back) * item_size);
+        memcpy(
+                buffer->data + front * item_size,
+                brd_value_list_start(list),
+                list->length * item_size
+        );
+        brd_value_list_buffer_release(list->buffer);
+        list->buffer = buffer;
+        brd_value_list_set_start(list, buffer->data + front * item_size);
+}
+
+/* box the numbers, once something other than a number is stored */
+static void
+brd_value_list_generalize(struct brd_value_list *list)
+{
+        struct brd_value_list_buffer *buffer;
+        struct brd_value *values;
+
+        buffer = brd_value_list_buffer_new(
+                (list->length + list->length / 2 + 4) * sizeof(struct brd_value)
+        );
+        values = (struct brd_value *)(void *)buffer->data;
+        for (size_t i = 0; i < list->length; i++) {
+                values[i].vtype = BRD_VAL_NUM;
+                values[i].as.num = list->as.nums[i];
+        }
+        brd_value_list_buffer_release(list->buffer);
+        list->buffer = buffer;
+        list->kind = BRD_LIST_VALUES;
+        list->as.values = values;
+}
+
+static void
+brd_value_list_accept(struct brd_value_list *list, struct brd_value *value)
+{
+        if (list->kind == BRD_LIST_NUMS && !IS_VAL(*value, BRD_VAL_NUM)) {
+                brd_value_list_generalize(list);
+        }
+}
+
+/* the list must already accept the value */
+static void
+brd_value_list_store(struct brd_value_list *list, size_t idx, struct brd_value *value)
+{
+        if (list->kind == BRD_LIST_NUMS && IS_VAL(*value, BRD_VAL_NUM)) {
+                list->as.nums[idx] = value->as.num;
+        } else {
+                list->as.values[idx] = *value;
+        }
+}
+
+/* a list of the given items with room for capacity items in total */
+void
+brd_value_list_init_items(
+        struct brd_value_list *list,
+        struct brd_value *items,
+        size_t num_items,
+        size_t capacity)
+{
+        enum brd_list_kind kind = BRD_LIST_NUMS;
+
+        for (size_t i = 0; i < num_items; i++) {
+                if (!IS_VAL(items[i], BRD_VAL_NUM)) {
+                        kind = BRD_LIST_VALUES;
+                        break;
+                }
+        }
+
+        brd_value_list_init_with_capacity(list, kind, capacity);
+        for (size_t i = 0; i < num_items; i++) {
+                brd_value_list_store(list, i, &items[i]);
+        }
+        list->length = num_items;
+}
+
+static int
+brd_value_list_shared(struct brd_value_list *list)
+{
+        return __atomic_load_n(&list->buffer->refs, __ATOMIC_ACQUIRE) > 1;
+}
+
+/* how many items fit before the start of the list without growing the buffer */
+static size_t
+brd_value_list_front_room(struct brd_value_list *list)
+{
+        return (brd_value_list_start(list) - list->buffer->data)
+                / brd_value_list_item_size(list);
+}
+
+/* how many items fit after the end of the list without growing the buffer */
+static size_t
+brd_value_list_room(struct brd_value_list *list)
+{
+        return (list->buffer->size - (brd_value_list_start(list) - list->buffer->data))
+                / brd_value_list_item_size(list) - list->length;
 }
 
 void
 brd_value_list_push(struct brd_value_list *list, struct brd_value *value)
 {
-        if (list->capacity == list->length) {
-                list->capacity *= 1.5;
-                list->items = realloc(
-                        list->items,
-                        sizeof(struct brd_value) * list->capacity
+        brd_value_list_accept(list, value);
+        if (brd_value_list_shared(list) || brd_value_list_room(list) == 0) {
+                brd_value_list_rebuffer(list, 0, list->length / 2 + 4);
+        }
+
+        brd_value_list_store(list, list->length++, value);
+}
+
+/*
+ * Pushing onto the front leaves room before the items when the buffer
+ * is grown, so that both ends are amortized O(1)
+ */
+void
+brd_value_list_push_front(struct brd_value_list *list, struct brd_value *value)
+{
+        brd_value_list_accept(list, value);
+        if (brd_value_list_shared(list) || brd_value_list_front_room(list) == 0) {
+                brd_value_list_rebuffer(
+                        list, list->length / 2 + 4, brd_value_list_room(list)
+                );
+        }
+
+        brd_value_list_set_start(
+                list, brd_value_list_start(list) - brd_value_list_item_size(list)
+        );
+        list->length++;
+        brd_value_list_store(list, 0, value);
+}
+
+/* idx must be at most the length of the list */
+void
+brd_value_list_insert(struct brd_value_list *list, size_t idx, struct brd_value *value)
+{
+        size_t item_size;
+        unsigned char *start;
+
+        brd_value_list_accept(list, value);
+        item_size = brd_value_list_item_size(list);
+        if (idx < list->length / 2
+                        && !brd_value_list_shared(list)
+                        && brd_value_list_front_room(list) > 0) {
+                /* closer to the front, so shift the items before idx down */
+                start = brd_value_list_start(list) - item_size;
+                memmove(start, start + item_size, idx * item_size);
+                brd_value_list_set_start(list, start);
+        } else {
+                if (brd_value_list_shared(list) || brd_value_list_room(list) == 0) {
+                        brd_value_list_rebuffer(
+                                list,
+                                brd_value_list_front_room(list),
+                                list->length / 2 + 4
+                        );
+                }
+                start = brd_value_list_start(list);
+                memmove(
+                        start + (idx + 1) * item_size,
+                        start + idx * item_size,
+                        (list->length - idx) * item_size
                 );
         }
 
-        list->items[list->length++] = *value;
+        list->length++;
+        brd_value_list_store(list, idx, value);
+}
+
+/* idx must be less than the length of the list */
+void
+brd_value_list_remove(struct brd_value_list *list, size_t idx, struct brd_value *out)
+{
+        size_t item_size = brd_value_list_item_size(list);
+        unsigned char *start = brd_value_list_start(list);
+
+        *out = brd_value_list_get(list, idx);
+        if (idx == list->length - 1) {
+                list->length--;
+                return;
+        } else if (idx == 0) {
+                brd_value_list_set_start(list, start + item_size);
+                list->length--;
+                return;
+        }
+
+        if (brd_value_list_shared(list)) {
+                brd_value_list_rebuffer(list, 0, 0);
+                start = brd_value_list_start(list);
+        }
+        if (idx < list->length / 2) {
+                memmove(start + item_size, start, idx * item_size);
+                brd_value_list_set_start(list, start + item_size);
+        } else {
+                memmove(
+                        start + idx * item_size,
+                        start + (idx + 1) * item_size,
+                        (list->length - idx - 1) * item_size
+                );
+        }
+        list->length--;
 }
 
 void
@@ -49,8 +318,12 @@ brd_value_list_set(struct brd_value_list *list, size_t idx, struct brd_value *va
         if (list->length == 0) {
                 brd_value_list_push(list, value);
         } else {
+                brd_value_list_accept(list, value);
+                if (brd_value_list_shared(list)) {
+                        brd_value_list_rebuffer(list, 0, 0);
+                }
                 idx = idx % list->length;
-                list->items[idx] = *value;
+                brd_value_list_store(list, idx, value);
         }
 }
 
@@ -64,9 +337,9 @@ brd_value_list_to_string(struct brd_value_list *list) {
         length = 4; // "[ ]" and null byte
 
         for (size_t i = 0; i < list->length; i++) {
-                list_strings[i] = list->items[i];
+                list_strings[i] = brd_value_list_get(list, i);
                 new_string[i] = brd_value_coerce_string(&list_strings[i]);
-                length += 2 + AS_STRING(list_strings[i])->length;
+                length += 2 + STRING_LENGTH(list_strings[i]);
         }
 
         string = malloc(length);
@@ -75,8 +348,8 @@ brd_value_list_to_string(struct brd_value_list *list) {
         string[length++] = ' ';
 
         for (size_t i = 0; i < list->length; i++) {
-                strcpy(string + length, AS_STRING(list_strings[i])->s);
-                length += AS_STRING(list_strings[i])->length;
+                strcpy(string + length, STRING_CHARS(list_strings[i]));
+                length += STRING_LENGTH(list_strings[i]);
                 if (i < list->length - 1) {
                         string[length++] = ',';
                 }
@@ -97,14 +370,15 @@ brd_value_list_to_string(struct brd_value_list *list) {
 int
 brd_value_list_equals(struct brd_value_list *a, struct brd_value_list *b)
 {
-        struct brd_comparison cmp;
         if (a->length != b->length) {
                 return false;
         }
 
         for (size_t i = 0; i < a->length; i++) {
-                cmp = brd_value_compare(&a->items[i], &b->items[i]);
-                if (!brd_comparison_eq(cmp)) {
+                struct brd_value va = brd_value_list_get(a, i);
+                struct brd_value vb = brd_value_list_get(b, i);
+
+                if (!brd_value_equals(&va, &vb)) {
                         return false;
                 }
         }
@@ -116,6 +390,218 @@ brd_value_string_init(struct brd_value_string *string, char *s)
 {
         string->s = s;
         string->length = strlen(s);
+        string->rope = NULL;
+        string->hash = 0;
+        string->num_state = BRD_STRING_NUM_UNKNOWN;
+}
+
+unsigned long
+brd_value_string_hash(struct brd_value_string *string)
+{
+        if (string->hash == 0) {
+                string->hash = hash(brd_value_string_flatten(string)->s);
+        }
+        return string->hash;
+}
+
+/* hash any value that can be a dict key, equal keys hash the same */
+static unsigned long
+brd_value_hash(struct brd_value *value)
+{
+        switch (value->vtype) {
+        case BRD_VAL_NUM:
+                if (value->as.num > -9e18L && value->as.num < 9e18L
+                                && value->as.num == (long long)value->as.num) {
+                        /* also covers -0 */
+                        return (unsigned long)(long long)value->as.num;
+                } else {
+                        double d = value->as.num;
+                        unsigned long long bits;
+                        memcpy(&bits, &d, sizeof(bits));
+                        return bits ^ (bits >> 32);
+                }
+        case BRD_VAL_STRING:
+                return brd_value_string_hash(value->as.string);
+        case BRD_VAL_SMALL_STRING:
+                return hash(value->as.small);
+        case BRD_VAL_BOOL:
+                return value->as.boolean ? 1231 : 1237;
+        case BRD_VAL_UNIT:
+                return 0;
+        case BRD_VAL_BUILTIN:
+                return value->as.builtin;
+        case BRD_VAL_METHOD:
+                return ((uintptr_t)value->as.method.this >> 4)
+                        ^ ((uintptr_t)value->as.method.fn >> 4);
+        case BRD_VAL_HEAP:
+                if (IS_HEAP(*value, BRD_HEAP_STRING)) {
+                        return brd_value_string_hash(value->as.heap->as.string);
+                }
+                return (uintptr_t)value->as.heap >> 4;
+        }
+
+        BARF("what?");
+        return 0;
+}
+
+/* whether two dict keys are the same, unlike = this never coerces */
+static int
+brd_value_key_equals(struct brd_value *a, struct brd_value *b)
+{
+        if (IS_STRING(*a) || IS_STRING(*b)) {
+                return IS_STRING(*a) && IS_STRING(*b) && brd_value_equals(a, b);
+        } else if (a->vtype != b->vtype) {
+                return false;
+        }
+
+        switch (a->vtype) {
+        case BRD_VAL_NUM:
+                return a->as.num == b->as.num;
+        case BRD_VAL_BOOL:
+                return a->as.boolean == b->as.boolean;
+        case BRD_VAL_UNIT:
+                return true;
+        case BRD_VAL_BUILTIN:
+                return a->as.builtin == b->as.builtin;
+        case BRD_VAL_METHOD:
+                return a->as.method.this == b->as.method.this
+                        && a->as.method.fn == b->as.method.fn;
+        case BRD_VAL_HEAP:
+                return a->as.heap == b->as.heap;
+        case BRD_VAL_STRING:
+        case BRD_VAL_SMALL_STRING:
+                break;
+        }
+        return false;
+}
+
+long double
+brd_value_string_num(struct brd_value_string *string)
+{
+        if (string->num_state == BRD_STRING_NUM_UNKNOWN) {
+                char *end, *s = brd_value_string_flatten(string)->s;
+                string->num = strtold(s, &end);
+                string->num_state = end == s ? BRD_STRING_NUM_INVALID : BRD_STRING_NUM_VALID;
+        }
+        return string->num;
+}
+
+/* coerce any kind of string to a number */
+static long double
+brd_value_parse_num(struct brd_value *value)
+{
+        if (IS_VAL(*value, BRD_VAL_SMALL_STRING)) {
+                return strtold(value->as.small, NULL);
+        }
+        return brd_value_string_num(AS_ROPE_STRING(*value));
+}
+
+/*
+ * Constant strings for every single character and for small integers.
+ * Like other string constants they're never on the heap, so the gc ignores
+ * them, and their cached hash and number survive between uses.
+ */
+static char char_chars[256][2];
+static struct brd_value_string char_strings[256];
+static char int_chars[INT_STRINGS][5];
+static struct brd_value_string int_strings[INT_STRINGS];
+
+void
+brd_value_init_string_constants(void)
+{
+        for (int i = 0; i < 256; i++) {
+                char_chars[i][0] = i;
+                char_chars[i][1] = '\0';
+                brd_value_string_init(&char_strings[i], char_chars[i]);
+                char_strings[i].length = 1;
+        }
+
+        for (int i = 0; i < INT_STRINGS; i++) {
+                sprintf(int_chars[i], "%d", i);
+                brd_value_string_init(&int_strings[i], int_chars[i]);
+        }
+}
+
+void
+brd_value_small_string(struct brd_value *value, const char *s, size_t length)
+{
+        value->vtype = BRD_VAL_SMALL_STRING;
+        value->small_length = length;
+        memcpy(value->as.small, s, length);
+        value->as.small[length] = '\0';
+}
+
+/* the characters a slice refers to, which aren't null terminated */
+static const char *
+brd_value_slice_chars(struct brd_value_rope *rope)
+{
+        return STRING_CHARS(rope->left) + rope->start;
+}
+
+struct brd_value_string *
+brd_value_string_flatten(struct brd_value_string *string)
+{
+        struct brd_value **stack;
+        size_t length, capacity, at;
+
+        if (string->rope == NULL) {
+                return string;
+        } else if (IS_VAL(string->rope->right, BRD_VAL_UNIT)) {
+                string->s = malloc(string->length + 1);
+                memcpy(string->s, brd_value_slice_chars(string->rope), string->length);
+                string->s[string->length] = '\0';
+                free(string->rope);
+                string->rope = NULL;
+                return string;
+        }
+
+        /* ropes can be very deep, so walk them with an explicit stack */
+        capacity = 16;
+        stack = malloc(sizeof(*stack) * capacity);
+        stack[0] = &string->rope->right;
+        stack[1] = &string->rope->left;
+        length = 2;
+        at = 0;
+        string->s = malloc(string->length + 1);
+        while (length > 0) {
+                struct brd_value *top = stack[--length];
+                struct brd_value_string *str;
+
+                if (IS_VAL(*top, BRD_VAL_SMALL_STRING)) {
+                        memcpy(string->s + at, top->as.small, top->small_length);
+                        at += top->small_length;
+                        continue;
+                }
+
+                str = AS_ROPE_STRING(*top);
+                if (str->rope == NULL) {
+                        memcpy(string->s + at, str->s, str->length);
+                        at += str->length;
+                        continue;
+                } else if (IS_VAL(str->rope->right, BRD_VAL_UNIT)) {
+                        memcpy(
+                                string->s + at,
+                                brd_value_slice_chars(str->rope),
+                                str->length
+                        );
+                        at += str->length;
+                        continue;
+                }
+
+                if (length + 2 > capacity) {
+                        capacity *= 1.5;
+                        stack = realloc(stack, sizeof(*stack) * capacity);
+                }
+                stack[length++] = &str->rope->right;
+                stack[length++] = &str->rope->left;
+        }
+        string->s[at] = '\0';
+        free(stack);
+
+        /* the operands are left for the gc */
+        free(string->rope);
+        string->rope = NULL;
+        return string;
 }
 
 struct brd_value_string *
@@ -150,6 +636,18 @@ brd_heap_new(enum brd_heap_type htype) {
         case BRD_HEAP_DICT:
                 heap->as.dict = malloc(sizeof(struct brd_value_dict));
                 break;
+        case BRD_HEAP_ARRAY:
+                heap->as.array = malloc(sizeof(struct brd_value_array));
+                break;
+        case BRD_HEAP_PQUEUE:
+                heap->as.pqueue = malloc(sizeof(struct brd_value_pqueue));
+                break;
+        case BRD_HEAP_SET:
+                heap->as.set = malloc(sizeof(struct brd_value_set));
+                break;
+        case BRD_HEAP_RANGE:
+                heap->as.range = malloc(sizeof(struct brd_value_range));
+                break;
         }
 
         return heap;
@@ -161,10 +659,11 @@ brd_heap_destroy(struct brd_heap_entry *entry)
         switch(entry->htype) {
         case BRD_HEAP_STRING:
                 free(entry->as.string->s);
+                free(entry->as.string->rope);
                 free(entry->as.string);
                 break;
         case BRD_HEAP_LIST:
-                free(entry->as.list->items);
+                brd_value_list_destroy(entry->as.list);
                 free(entry->as.list);
                 break;
         case BRD_HEAP_CLOSURE:
@@ -185,101 +684,248 @@ brd_heap_destroy(struct brd_heap_entry *entry)
                 brd_value_dict_destroy(entry->as.dict);
                 free(entry->as.dict);
                 break;
+        case BRD_HEAP_ARRAY:
+                brd_value_array_destroy(entry->as.array);
+                free(entry->as.array);
+                break;
+        case BRD_HEAP_PQUEUE:
+                brd_value_pqueue_destroy(entry->as.pqueue);
+                free(entry->as.pqueue);
+                break;
+        case BRD_HEAP_SET:
+                brd_value_set_destroy(entry->as.set);
+                free(entry->as.set);
+                break;
+        case BRD_HEAP_RANGE:
+                free(entry->as.range);
+                break;
         }
         free(entry);
 }
 
-void
-brd_value_gc_mark(struct brd_value *value)
+/* rough number of bytes used by a heap entry, not counting its children */
+size_t
+brd_heap_size(struct brd_heap_entry *entry)
 {
-        struct brd_value v;
-        if (value->vtype == BRD_VAL_HEAP) {
-                struct brd_heap_entry *entry = value->as.heap;
-                if (entry->marked) {
-                        return;
-                }
+        size_t size = sizeof(struct brd_heap_entry);
 
-                entry->marked = true;
-                switch (entry->htype) {
-                case BRD_HEAP_STRING:
-                        break;
-                case BRD_HEAP_LIST:
-                        for (size_t i = 0; i < entry->as.list->length; i++) {
-                                brd_value_gc_mark(&entry->as.list->items[i]);
-                        }
-                        break;
-                case BRD_HEAP_CLOSURE:
-                        brd_value_map_mark(&entry->as.closure->env);
-                        break;
-                case BRD_HEAP_CLASS:
-                        /* @Object is marked before GCing, so this is fine */
-                        v = brd_heap_value(closure, entry->as.class->constructor);
-                        brd_value_gc_mark(&v);
-                        v = brd_heap_value(class, entry->as.class->super);
-                        brd_value_gc_mark(&v);
-                        brd_value_map_mark(&entry->as.class->methods);
-                        break;
-                case BRD_HEAP_OBJECT:
-                        v = brd_heap_value(class, entry->as.object->class);
-                        brd_value_gc_mark(&v);
-                        brd_value_map_mark(&entry->as.object->fields);
-                        break;
-                case BRD_HEAP_DICT:
-                        for (size_t i = 0; i < entry->as.dict->keys.length; i++) {
-                                brd_value_gc_mark(&entry->as.dict->keys.items[i]);
-                        }
-                        brd_value_map_mark(&entry->as.dict->map);
-                        break;
+        switch (entry->htype) {
+        case BRD_HEAP_STRING:
+                size += sizeof(struct brd_value_string);
+                if (entry->as.string->rope != NULL) {
+                        size += sizeof(struct brd_value_rope);
+                } else {
+                        size += entry->as.string->length + 1;
                 }
-        } else if (value->vtype == BRD_VAL_METHOD) {
-                v = brd_heap_value(object, value->as.method.this);
-                brd_value_gc_mark(&v);
-                v = brd_heap_value(closure, value->as.method.fn);
-                brd_value_gc_mark(&v);
+                break;
+        case BRD_HEAP_LIST:
+                size += sizeof(struct brd_value_list);
+                if (!brd_value_list_shared(entry->as.list)) {
+                        size += sizeof(struct brd_value_list_buffer);
+                        size += entry->as.list->buffer->size;
+                }
+                break;
+        case BRD_HEAP_CLOSURE:
+                /* closures are registered before they are initialized */
+                size += sizeof(struct brd_value_closure);
+                break;
+        case BRD_HEAP_CLASS:
+                size += sizeof(struct brd_value_class);
+                break;
+        case BRD_HEAP_OBJECT:
+                size += sizeof(struct brd_value_object);
+                break;
+        case BRD_HEAP_DICT:
+                size += sizeof(struct brd_value_dict);
+                size += sizeof(long) * entry->as.dict->capacity;
+                size += sizeof(struct brd_value_dict_entry)
+                        * brd_value_dict_usable(entry->as.dict->capacity);
+                break;
+        case BRD_HEAP_ARRAY:
+                size += sizeof(struct brd_value_array);
+                size += 8 * entry->as.array->length;
+                break;
+        case BRD_HEAP_PQUEUE:
+                size += sizeof(struct brd_value_pqueue);
+                size += sizeof(struct brd_value_pqueue_entry) * entry->as.pqueue->capacity;
+                break;
+        case BRD_HEAP_SET:
+                size += sizeof(struct brd_value_set);
+                size += sizeof(long) * entry->as.set->dict.capacity;
+                size += sizeof(struct brd_value_dict_entry)
+                        * brd_value_dict_usable(entry->as.set->dict.capacity);
+                break;
+        case BRD_HEAP_RANGE:
+                size += sizeof(struct brd_value_range);
+                break;
         }
+
+        return size;
 }
 
-void
-brd_value_map_init(struct brd_value_map *map)
+struct brd_value_string *
+brd_heap_type_string(enum brd_heap_type htype)
 {
-        map->bucket = malloc(sizeof(struct brd_value_map_list) * BUCKET_SIZE);
-        for (int i = 0; i < BUCKET_SIZE; i++) {
-                map->bucket[i].key = "";
-                map->bucket[i].val.vtype = BRD_VAL_UNIT;
-                map->bucket[i].next = NULL;
+        switch (htype) {
+        case BRD_HEAP_STRING: return &string_string;
+        case BRD_HEAP_LIST: return &list_string;
+        case BRD_HEAP_CLOSURE: return &closure_string;
+        case BRD_HEAP_CLASS: return &class_string;
+        case BRD_HEAP_OBJECT: return &object_string;
+        case BRD_HEAP_DICT: return &dict_string;
+        case BRD_HEAP_ARRAY: return &array_string;
+        case BRD_HEAP_PQUEUE: return &pqueue_string;
+        case BRD_HEAP_SET: return &set_string;
+        case BRD_HEAP_RANGE: return &range_string;
         }
+
+        BARF("unknown heap type");
+        return NULL;
 }
 
 void
-brd_value_map_destroy(struct brd_value_map *map)
+brd_value_gc_mark(struct brd_value *value, struct brd_gc_stack *gray)
 {
-        /* At this point in time I'm not going to free the strings */
+        struct brd_heap_entry *entry;
 
-        for (int i = 0; i < BUCKET_SIZE; i++) {
-                struct brd_value_map_list *list = map->bucket[i].next;
-                
-                while (list != NULL) {
-                        struct brd_value_map_list *next = list->next;
-                        free(list);
-                        list = next;
+        if (value->vtype == BRD_VAL_HEAP) {
+                entry = value->as.heap;
+                if (brd_gc_try_mark(entry)) {
+                        brd_gc_stack_push(gray, entry);
+                }
+        } else if (value->vtype == BRD_VAL_METHOD) {
+                entry = brd_containing_heap(object, value->as.method.this);
+                if (brd_gc_try_mark(entry)) {
+                        brd_gc_stack_push(gray, entry);
+                }
+                entry = brd_containing_heap(closure, value->as.method.fn);
+                if (brd_gc_try_mark(entry)) {
+                        brd_gc_stack_push(gray, entry);
                 }
         }
-        free(map->bucket);
 }
 
+/*
+ * Mark everything an already marked heap entry refers to. Children are
+ * pushed onto the gray stack rather than traced recursively, so that
+ * deeply nested lists don't blow the C stack and so that the work can be
+ * split between gc threads.
+ */
 void
-brd_value_map_set(struct brd_value_map *map, char *key, struct brd_value *val)
+brd_heap_gc_trace(struct brd_heap_entry *entry, struct brd_gc_stack *gray)
 {
-        /* return true if key already in dict */
-        unsigned long h = hash(key) % BUCKET_SIZE;
-        struct brd_value_map_list *list = &map->bucket[h];
+        struct brd_value v;
 
-        /*
-         * Always at least 1 iteration since each bucket entry
+        switch (entry->htype) {
+        case BRD_HEAP_STRING:
+                if (entry->as.string->rope != NULL) {
+                        brd_value_gc_mark(&entry->as.string->rope->left, gray);
+                        brd_value_gc_mark(&entry->as.string->rope->right, gray);
+                }
+                break;
+        case BRD_HEAP_LIST:
+                /* unboxed numbers have nothing to mark */
+                if (entry->as.list->kind == BRD_LIST_VALUES) {
+                        for (size_t i = 0; i < entry->as.list->length; i++) {
+                                brd_value_gc_mark(&entry->as.list->as.values[i], gray);
+                        }
+                }
+                break;
+        case BRD_HEAP_CLOSURE:
+                brd_value_map_mark(&entry->as.closure->env, gray);
+                break;
+        case BRD_HEAP_CLASS:
+                /* @Object is marked before GCing, so this is fine */
+                v = brd_heap_value(closure, entry->as.class->constructor);
+                brd_value_gc_mark(&v, gray);
+                v = brd_heap_value(class, entry->as.class->super);
+                brd_value_gc_mark(&v, gray);
+                brd_value_map_mark(&entry->as.class->methods, gray);
+                break;
+        case BRD_HEAP_OBJECT:
+                v = brd_heap_value(class, entry->as.object->class);
+                brd_value_gc_mark(&v, gray);
+                brd_value_map_mark(&entry->as.object->fields, gray);
+                break;
+        case BRD_HEAP_DICT:
+                for (size_t i = 0; i < entry->as.dict->length; i++) {
+                        struct brd_value_dict_entry *e = &entry->as.dict->entries[i];
+                        brd_value_gc_mark(&e->key, gray);
+                        brd_value_gc_mark(&e->value, gray);
+                }
+                break;
+        case BRD_HEAP_ARRAY:
+                /* only holds numbers */
+                break;
+        case BRD_HEAP_PQUEUE:
+                brd_value_gc_mark(&entry->as.pqueue->key_fn, gray);
+                for (size_t i = 0; i < entry->as.pqueue->length; i++) {
+                        brd_value_gc_mark(&entry->as.pqueue->entries[i].key, gray);
+                        brd_value_gc_mark(&entry->as.pqueue->entries[i].value, gray);
+                }
+                break;
+        case BRD_HEAP_SET:
+                /* the values are all true */
+                for (size_t i = 0; i < entry->as.set->dict.length; i++) {
+                        brd_value_gc_mark(&entry->as.set->dict.entries[i].key, gray);
+                }
+                break;
+        case BRD_HEAP_RANGE:
+                break;
+        }
+}
+
+void
+brd_value_map_init(struct brd_value_map *map)
+{
+        map->bucket = malloc(sizeof(struct brd_value_map_list) * BUCKET_SIZE);
+        for (int i = 0; i < BUCKET_SIZE; i++) {
+                map->bucket[i].key = "";
+                map->bucket[i].hash = hash("");
+                map->bucket[i].val.vtype = BRD_VAL_UNIT;
+                map->bucket[i].next = NULL;
+        }
+}
+
+void
+brd_value_map_destroy(struct brd_value_map *map)
+{
+        /* At this point in time I'm not going to free the strings */
+
+        for (int i = 0; i < BUCKET_SIZE; i++) {
+                struct brd_value_map_list *list = map->bucket[i].next;
+                
+                while (list != NULL) {
+                        struct brd_value_map_list *next = list->next;
+                        free(list);
+                        list = next;
+                }
+        }
+        free(map->bucket);
+}
+
+void
+brd_value_map_set(struct brd_value_map *map, char *key, struct brd_value *val)
+{
+        brd_value_map_set_hashed(map, key, hash(key), val);
+}
+
+/* h must be the hash of key, which lets strings with cached hashes skip it */
+void
+brd_value_map_set_hashed(
+        struct brd_value_map *map,
+        char *key,
+        unsigned long h,
+        struct brd_value *val)
+{
+        struct brd_value_map_list *list = &map->bucket[h % BUCKET_SIZE];
+
+        /*
+         * Always at least 1 iteration since each bucket entry
          * has an initial dummy value
          */
         for (;;) {
-                if (strcmp(list->key, key) == 0) {
+                if (list->hash == h && strcmp(list->key, key) == 0) {
                         list->val = *val;
                         return;
                 } else if (list->next == NULL) {
@@ -292,6 +938,7 @@ brd_value_map_set(struct brd_value_map *map, char *key, struct brd_value *val)
         /* key not in list */
         list->next = malloc(sizeof(struct brd_value_map_list));
         list->next->key = key;
+        list->next->hash = h;
         list->next->val = *val;
         list->next->next = NULL;
         return;
@@ -300,11 +947,16 @@ brd_value_map_set(struct brd_value_map *map, char *key, struct brd_value *val)
 struct brd_value *
 brd_value_map_get(struct brd_value_map *map, char *key)
 {
-        unsigned long h = hash(key) % BUCKET_SIZE;
-        struct brd_value_map_list *list = &map->bucket[h];
+        return brd_value_map_get_hashed(map, key, hash(key));
+}
+
+struct brd_value *
+brd_value_map_get_hashed(struct brd_value_map *map, char *key, unsigned long h)
+{
+        struct brd_value_map_list *list = &map->bucket[h % BUCKET_SIZE];
 
         do {
-                if (strcmp(list->key, key) == 0) {
+                if (list->hash == h && strcmp(list->key, key) == 0) {
                         return &list->val;
                 }
         } while ((list = list->next) != NULL);
@@ -312,25 +964,40 @@ brd_value_map_get(struct brd_value_map *map, char *key)
         return NULL;
 }
 
+void
+brd_value_map_remove_hashed(struct brd_value_map *map, char *key, unsigned long h)
+{
+        struct brd_value_map_list *list = &map->bucket[h % BUCKET_SIZE], *next;
+
+        /* the dummy value at the head of each bucket is never removed */
+        for (; (next = list->next) != NULL; list = next) {
+                if (next->hash == h && strcmp(next->key, key) == 0) {
+                        list->next = next->next;
+                        free(next);
+                        return;
+                }
+        }
+}
+
 void
 brd_value_map_copy(struct brd_value_map *dest, struct brd_value_map *src)
 {
         for (int i = 0; i < BUCKET_SIZE; i++) {
                 struct brd_value_map_list *entry = src->bucket[i].next;
                 while (entry != NULL) {
-                        brd_value_map_set(dest, entry->key, &entry->val);
+                        brd_value_map_set_hashed(dest, entry->key, entry->hash, &entry->val);
                         entry = entry->next;
                 }
         }
 }
 
 void
-brd_value_map_mark(struct brd_value_map *map)
+brd_value_map_mark(struct brd_value_map *map, struct brd_gc_stack *gray)
 {
         for (int i = 0; i < BUCKET_SIZE; i++) {
                 struct brd_value_map_list *p = &map->bucket[i];
                 while (p != NULL) {
-                        brd_value_gc_mark(&p->val);
+                        brd_value_gc_mark(&p->val, gray);
                         p = p->next;
                 }
         }
@@ -410,31 +1077,125 @@ brd_value_object_destroy(struct brd_value_object *object)
         brd_value_map_destroy(&object->fields);
 }
 
+/* how many entries fit before the index is too full */
+size_t
+brd_value_dict_usable(size_t capacity)
+{
+        return capacity * 2 / 3;
+}
+
+static void
+brd_value_dict_alloc(struct brd_value_dict *dict, size_t capacity)
+{
+        dict->capacity = capacity;
+        dict->index = malloc(sizeof(long) * capacity);
+        memset(dict->index, 0xff, sizeof(long) * capacity); /* all DICT_EMPTY */
+        dict->entries = malloc(
+                sizeof(struct brd_value_dict_entry) * brd_value_dict_usable(capacity)
+        );
+        dict->length = 0;
+}
+
 void
 brd_value_dict_init(struct brd_value_dict *dict)
 {
-        brd_value_list_init(&dict->keys);
-        brd_value_map_init(&dict->map);
+        brd_value_dict_alloc(dict, DICT_SIZE);
+        dict->size = 0;
+        dict->iterators = 0;
+}
+
+/* a dict which can hold size entries without being resized */
+void
+brd_value_dict_init_with_size(struct brd_value_dict *dict, size_t size)
+{
+        size_t capacity = DICT_SIZE;
+
+        while (brd_value_dict_usable(capacity) < size) {
+                capacity *= 2;
+        }
+        brd_value_dict_alloc(dict, capacity);
         dict->size = 0;
+        dict->iterators = 0;
 }
 
 void
 brd_value_dict_destroy(struct brd_value_dict *dict)
 {
-        brd_value_map_destroy(&dict->map);
-        free(dict->keys.items);
+        free(dict->entries);
+        free(dict->index);
+}
+
+/* mix the hash so that pointers and sequential numbers spread over the index */
+static size_t
+brd_value_dict_slot(struct brd_value_dict *dict, unsigned long h)
+{
+        h ^= h >> 16;
+        h *= 0x45d9f3b;
+        h ^= h >> 16;
+        return h & (dict->capacity - 1);
+}
+
+/*
+ * Rebuild the dict with room for twice as many entries as are left,
+ * which also drops removed entries, unless a loop is going over the
+ * dict, in which case they're kept so no entry changes position
+ */
+static void
+brd_value_dict_resize(struct brd_value_dict *dict)
+{
+        struct brd_value_dict_entry *old = dict->entries;
+        size_t old_length = dict->length, capacity = DICT_SIZE;
+        size_t keep = dict->iterators > 0 ? dict->length : dict->size;
+
+        while (brd_value_dict_usable(capacity) <= keep * 2) {
+                capacity *= 2;
+        }
+
+        free(dict->index);
+        brd_value_dict_alloc(dict, capacity);
+        for (size_t i = 0; i < old_length; i++) {
+                size_t slot;
+
+                if (IS_VAL(old[i].value, BRD_VAL_UNIT)) {
+                        if (dict->iterators > 0) {
+                                dict->entries[dict->length++] = old[i];
+                        }
+                        continue;
+                }
+                slot = brd_value_dict_slot(dict, old[i].hash);
+                while (dict->index[slot] != DICT_EMPTY) {
+                        slot = (slot + 1) & (dict->capacity - 1);
+                }
+                dict->index[slot] = dict->length;
+                dict->entries[dict->length++] = old[i];
+        }
+        free(old);
+}
+
+/* return the slot in the index holding key, or DICT_EMPTY */
+static long
+brd_value_dict_find(struct brd_value_dict *dict, struct brd_value *key, unsigned long h)
+{
+        size_t slot = brd_value_dict_slot(dict, h);
+
+        for (;; slot = (slot + 1) & (dict->capacity - 1)) {
+                long i = dict->index[slot];
+                if (i == DICT_EMPTY) {
+                        return DICT_EMPTY;
+                } else if (i != DICT_DELETED
+                                && dict->entries[i].hash == h
+                                && brd_value_key_equals(&dict->entries[i].key, key)) {
+                        return slot;
+                }
+        }
 }
 
 struct brd_value *
 brd_value_dict_get(struct brd_value_dict *dict, struct brd_value *key)
 {
-        if (IS_STRING(*key)) {
-                char *k = AS_STRING(*key)->s;
-                return brd_value_map_get(&dict->map, k);
-        } else {
-                BARF("dict key must be a string");
-                return NULL;
-        }
+        long slot = brd_value_dict_find(dict, key, brd_value_hash(key));
+
+        return slot == DICT_EMPTY ? NULL : &dict->entries[dict->index[slot]].value;
 }
 
 void
@@ -443,67 +1204,88 @@ brd_value_dict_set(
         struct brd_value *key,
         struct brd_value *value)
 {
-        char *k;
-        struct brd_value *vp;
-
-        if (!IS_STRING(*key)) {
-                BARF("dict key must be a string");
-        }
-        
-        k = AS_STRING(*key)->s;
-        vp = brd_value_map_get(&dict->map, k);
+        unsigned long h = brd_value_hash(key);
+        long slot = brd_value_dict_find(dict, key, h);
+        struct brd_value_dict_entry *entry;
+        size_t s;
 
-        if (vp == NULL) {
+        if (slot != DICT_EMPTY) {
+                entry = &dict->entries[dict->index[slot]];
                 if (!IS_VAL(*value, BRD_VAL_UNIT)) {
-                        dict->size++;
-                }
-                if (IS_VAL(*key, BRD_VAL_HEAP)) {
-                        brd_value_list_push(&dict->keys, key);
+                        entry->value = *value;
+                        return;
                 }
-                brd_value_map_set(&dict->map, k, value);
-        } else {
-                if (IS_VAL(*vp, BRD_VAL_UNIT) && !IS_VAL(*value, BRD_VAL_UNIT)) {
-                        dict->size++;
-                } else if (!IS_VAL(*vp, BRD_VAL_UNIT) && IS_VAL(*value, BRD_VAL_UNIT)) {
-                        dict->size--;
+
+                /* remove the entry, compacting once most entries are holes */
+                entry->key.vtype = BRD_VAL_UNIT;
+                entry->value.vtype = BRD_VAL_UNIT;
+                dict->index[slot] = DICT_DELETED;
+                dict->size--;
+                if (dict->iterators == 0
+                                && dict->length - dict->size > dict->size + DICT_SIZE) {
+                        brd_value_dict_resize(dict);
                 }
-                *vp = *value;
+                return;
+        } else if (IS_VAL(*value, BRD_VAL_UNIT)) {
+                return;
         }
+
+        if (dict->length == brd_value_dict_usable(dict->capacity)) {
+                brd_value_dict_resize(dict);
+        }
+
+        s = brd_value_dict_slot(dict, h);
+        while (dict->index[s] >= 0) {
+                s = (s + 1) & (dict->capacity - 1);
+        }
+        dict->index[s] = dict->length;
+        entry = &dict->entries[dict->length++];
+        entry->key = *key;
+        entry->value = *value;
+        entry->hash = h;
+        dict->size++;
 }
 
-char *
-brd_value_dict_to_string(struct brd_value_dict *dict)
+/* the live entries between braces, sets only print their keys */
+static char *
+brd_value_dict_entries_to_string(struct brd_value_dict *dict, int with_values)
 {
         char *s, **strings = malloc(sizeof(char *) * dict->size);
         int *lengths = malloc(sizeof(int) * dict->size);
-        struct brd_value value;
-        int new, idx = 0, total_length;
+        struct brd_value key, value;
+        int new_key, new_value = false, idx = 0, total_length;
 
         total_length = 4 + 2 * dict->size;
 
-        for (int i = 0; i < BUCKET_SIZE; i++) {
-                struct brd_value_map_list *list = dict->map.bucket[i].next;
-
-                while (list != NULL) {
-                        if (IS_VAL(list->val, BRD_VAL_UNIT)) {
-                                list = list->next;
-                                continue;
-                        }
-                        value = list->val;
-                        new = brd_value_coerce_string(&value);
-                        s = malloc(strlen(list->key) + AS_STRING(value)->length + 6);
+        for (size_t i = 0; i < dict->length; i++) {
+                struct brd_value_dict_entry *entry = &dict->entries[i];
+                const char *quote = IS_STRING(entry->key) ? "\"" : "";
 
+                if (IS_VAL(entry->value, BRD_VAL_UNIT)) {
+                        continue;
+                }
+                key = entry->key;
+                new_key = brd_value_coerce_string(&key);
+                if (with_values) {
+                        value = entry->value;
+                        new_value = brd_value_coerce_string(&value);
+                        s = malloc(STRING_LENGTH(key) + STRING_LENGTH(value) + 6);
                         lengths[idx] = sprintf(
-                                s, "\"%s\" : %s",
-                                list->key, AS_STRING(value)->s
+                                s, "%s%s%s : %s",
+                                quote, STRING_CHARS(key), quote, STRING_CHARS(value)
                         );
-                        strings[idx] = s;
-                        total_length += lengths[idx];
-                        idx++;
-                        if (new) {
-                                brd_heap_destroy(value.as.heap);
-                        }
-                        list = list->next;
+                } else {
+                        s = malloc(STRING_LENGTH(key) + 3);
+                        lengths[idx] = sprintf(s, "%s%s%s", quote, STRING_CHARS(key), quote);
+                }
+                strings[idx] = s;
+                total_length += lengths[idx];
+                idx++;
+                if (new_key) {
+                        brd_heap_destroy(key.as.heap);
+                }
+                if (new_value) {
+                        brd_heap_destroy(value.as.heap);
                 }
         }
 
@@ -530,133 +1312,537 @@ brd_value_dict_to_string(struct brd_value_dict *dict)
         return s;
 }
 
+char *
+brd_value_dict_to_string(struct brd_value_dict *dict)
+{
+        return brd_value_dict_entries_to_string(dict, true);
+}
+
+void
+brd_value_set_init(struct brd_value_set *set)
+{
+        brd_value_dict_init(&set->dict);
+}
+
+void
+brd_value_set_destroy(struct brd_value_set *set)
+{
+        brd_value_dict_destroy(&set->dict);
+}
+
 int
-brd_comparison_eq(struct brd_comparison cmp)
+brd_value_set_has(struct brd_value_set *set, struct brd_value *item)
 {
-        return cmp.is_ord ? cmp.cmp == 0 : cmp.cmp;
+        return brd_value_dict_get(&set->dict, item) != NULL;
 }
 
 void
-brd_value_debug(struct brd_value *value)
+brd_value_set_add(struct brd_value_set *set, struct brd_value *item)
 {
-        switch (value->vtype) {
-        case BRD_VAL_NUM:
-                printf("%.10Lg", value->as.num);
-                break;
-        case BRD_VAL_STRING:
-                printf("\"%s\"", value->as.string->s);
-                break;
-        case BRD_VAL_BOOL:
-                printf("%s", value->as.boolean ? "true" : "false");
-                break;
-        case BRD_VAL_UNIT:
-                printf("unit");
-                break;
-        case BRD_VAL_BUILTIN:
-                printf("<< builtin: %s >>", builtin_name[value->as.builtin]);
-                break;
-        case BRD_VAL_METHOD:
-                printf("<< method >>");
-                break;
-        case BRD_VAL_HEAP:
-                switch (value->as.heap->htype) {
-                case BRD_HEAP_STRING:
-                        printf("\"%s\"", value->as.heap->as.string->s);
-                        break;
-                case BRD_HEAP_LIST:
-                        printf("[ ");
-                        for (size_t i = 0; i < value->as.heap->as.list->length; i++) {
-                                brd_value_debug(
-                                        &value->as.heap->as.list->items[i]
-                                );
-                                if (i < value->as.heap->as.list->length - 1) {
-                                        printf(",");
-                                }
-                                printf(" ");
-                        }
-                        printf("]");
-                        break;
-                case BRD_HEAP_CLOSURE:
-                        printf("<< closure >>");
-                        break;
-                case BRD_HEAP_CLASS:
-                        printf("<< class >>");
-                        break;
-                case BRD_HEAP_OBJECT:
-                        printf("<< object >>");
-                        break;
-                case BRD_HEAP_DICT:
-                        printf("<< dict >>");
-                        break;
-                }
+        struct brd_value present;
+
+        present.vtype = BRD_VAL_BOOL;
+        present.as.boolean = true;
+        brd_value_dict_set(&set->dict, item, &present);
+}
+
+/* returns whether the item was in the set */
+int
+brd_value_set_discard(struct brd_value_set *set, struct brd_value *item)
+{
+        struct brd_value unit;
+
+        if (!brd_value_set_has(set, item)) {
+                return false;
         }
+        unit.vtype = BRD_VAL_UNIT;
+        brd_value_dict_set(&set->dict, item, &unit);
+        return true;
 }
 
-int brd_value_is_string(struct brd_value *value)
+char *
+brd_value_set_to_string(struct brd_value_set *set)
 {
-        return IS_VAL(*value, BRD_VAL_STRING) || IS_HEAP(*value, BRD_HEAP_STRING);
+        return brd_value_dict_entries_to_string(&set->dict, false);
 }
 
 void
-brd_value_coerce_num(struct brd_value *value)
+brd_value_array_init(struct brd_value_array *array, enum brd_array_kind kind, size_t length)
 {
-        switch (value->vtype) {
-        case BRD_VAL_NUM:
-                break;
-        case BRD_VAL_STRING:
-                value->as.num = strtold(value->as.string->s, NULL);
-                break;
-        case BRD_VAL_BOOL:
-                value->as.num = value->as.boolean ? 1 : 0;
-                break;
-        case BRD_VAL_UNIT:
-                value->as.num = 0;
+        /* both kinds of array have 8 byte items */
+        void *items = calloc(length, sizeof(double));
+
+        if (items == NULL && length > 0) {
+                BARF("not enough memory for the array");
+        }
+        array->kind = kind;
+        array->length = length;
+        switch (kind) {
+        case BRD_ARRAY_F64:
+                array->as.f64 = items;
                 break;
-        case BRD_VAL_BUILTIN:
-                BARF("builtin functions can't be coerced to a number");
+        case BRD_ARRAY_I64:
+                array->as.i64 = items;
                 break;
-        case BRD_VAL_METHOD:
-                BARF("can't coerce a method into a number");
+        }
+}
+
+void
+brd_value_array_destroy(struct brd_value_array *array)
+{
+        switch (array->kind) {
+        case BRD_ARRAY_F64:
+                free(array->as.f64);
                 break;
-        case BRD_VAL_HEAP:
-                switch (value->as.heap->htype) {
-                case BRD_HEAP_STRING:
-                        value->as.num = strtold(value->as.heap->as.string->s, NULL);
-                        break;
-                case BRD_HEAP_LIST:
-                        BARF("can't coerce a list to a number");
-                        break;
-                case BRD_HEAP_CLOSURE:
-                        BARF("can't coerce a closure to a number");
-                        break;
-                case BRD_HEAP_CLASS:
-                        BARF("can't coerce a class into a number");
-                        break;
-                case BRD_HEAP_OBJECT:
-                        BARF("can't coerce an object into a number");
-                        break;
-                case BRD_HEAP_DICT:
-                        BARF("can't coerce a dict into a number");
-                }
+        case BRD_ARRAY_I64:
+                free(array->as.i64);
                 break;
         }
-        value->vtype = BRD_VAL_NUM;
 }
 
-int
-brd_value_coerce_string(struct brd_value *value)
+void
+brd_value_array_get(struct brd_value_array *array, size_t idx, struct brd_value *out)
 {
-        /* return true if new allocation was made */
+        out->vtype = BRD_VAL_NUM;
+        if (array->kind == BRD_ARRAY_F64) {
+                out->as.num = array->as.f64[idx];
+        } else {
+                out->as.num = array->as.i64[idx];
+        }
+}
+
+/* numbers outside the range of an i64 are clamped, and NaN becomes 0 */
+static int64_t
+brd_value_to_i64(long double num)
+{
+        if (num != num) {
+                return 0;
+        } else if (num >= 9223372036854775807.0L) {
+                return INT64_MAX;
+        } else if (num <= -9223372036854775808.0L) {
+                return INT64_MIN;
+        }
+        return num;
+}
+
+/* the index wraps around like it does for lists */
+void
+brd_value_array_set(struct brd_value_array *array, intmax_t idx, struct brd_value *value)
+{
+        struct brd_value num = *value;
+
+        if (array->length == 0) {
+                BARF("can't set an element of an empty array");
+        }
+        idx %= (intmax_t)array->length;
+        if (idx < 0) {
+                idx += array->length;
+        }
+
+        brd_value_coerce_num(&num);
+        switch (array->kind) {
+        case BRD_ARRAY_F64:
+                array->as.f64[idx] = num.as.num;
+                break;
+        case BRD_ARRAY_I64:
+                array->as.i64[idx] = brd_value_to_i64(num.as.num);
+                break;
+        }
+}
+
+char *
+brd_value_array_to_string(struct brd_value_array *array)
+{
+        char *s = malloc(4 + array->length * (SMALL_STRING_MAX + 2));
+        size_t length = 0;
+
+        s[length++] = '[';
+        s[length++] = ' ';
+        for (size_t i = 0; i < array->length; i++) {
+                struct brd_value value;
+
+                brd_value_array_get(array, i, &value);
+                length += brd_value_format_num(value.as.num, s + length);
+                if (i < array->length - 1) {
+                        s[length++] = ',';
+                }
+                s[length++] = ' ';
+        }
+        s[length++] = ']';
+        s[length] = '\0';
+
+        return s;
+}
+
+void
+brd_value_pqueue_init(struct brd_value_pqueue *pqueue, struct brd_value *key_fn)
+{
+        pqueue->key_fn = *key_fn;
+        pqueue->capacity = 8;
+        pqueue->entries = malloc(sizeof(*pqueue->entries) * pqueue->capacity);
+        pqueue->length = 0;
+}
+
+void
+brd_value_pqueue_destroy(struct brd_value_pqueue *pqueue)
+{
+        free(pqueue->entries);
+}
+
+static int
+brd_value_pqueue_less(struct brd_value_pqueue_entry *a, struct brd_value_pqueue_entry *b)
+{
+        struct brd_comparison cmp = brd_value_compare(&a->key, &b->key);
+
+        if (!cmp.is_ord) {
+                BARF("the keys in a heap must be ordered, like numbers or strings");
+        }
+        return cmp.cmp < 0;
+}
+
+void
+brd_value_pqueue_push(
+        struct brd_value_pqueue *pqueue,
+        struct brd_value *key,
+        struct brd_value *value)
+{
+        struct brd_value_pqueue_entry entry = { *key, *value };
+        size_t idx = pqueue->length++;
+
+        if (pqueue->length > pqueue->capacity) {
+                pqueue->capacity *= 2;
+                pqueue->entries = realloc(
+                        pqueue->entries,
+                        sizeof(*pqueue->entries) * pqueue->capacity
+                );
+        }
+
+        /* sift the hole up to where the entry belongs */
+        while (idx > 0) {
+                size_t parent = (idx - 1) / 2;
+
+                if (!brd_value_pqueue_less(&entry, &pqueue->entries[parent])) {
+                        break;
+                }
+                pqueue->entries[idx] = pqueue->entries[parent];
+                idx = parent;
+        }
+        pqueue->entries[idx] = entry;
+}
+
+/* the queue must not be empty */
+void
+brd_value_pqueue_pop(struct brd_value_pqueue *pqueue, struct brd_value *out)
+{
+        struct brd_value_pqueue_entry last;
+        size_t idx = 0, child;
+
+        *out = pqueue->entries[0].value;
+        last = pqueue->entries[--pqueue->length];
+
+        /* sift the hole left at the root down to where the last entry belongs */
+        while ((child = 2 * idx + 1) < pqueue->length) {
+                if (child + 1 < pqueue->length && brd_value_pqueue_less(
+                                &pqueue->entries[child + 1], &pqueue->entries[child])) {
+                        child++;
+                }
+                if (!brd_value_pqueue_less(&pqueue->entries[child], &last)) {
+                        break;
+                }
+                pqueue->entries[idx] = pqueue->entries[child];
+                idx = child;
+        }
+        pqueue->entries[idx] = last;
+}
+
+void
+brd_value_range_init(
+        struct brd_value_range *range,
+        long double start,
+        long double stop,
+        long double step)
+{
+        long double length = ceill((stop - start) / step);
+
+        if (length >= 0x1p63L) {
+                BARF("range is too long");
+        }
+        range->start = start;
+        range->step = step;
+        range->length = length > 0 ? length : 0;
+}
+
+long double
+brd_value_range_get(struct brd_value_range *range, size_t idx)
+{
+        return range->start + idx * range->step;
+}
+
+int
+brd_value_iterable(struct brd_value *value)
+{
+        return IS_STRING(*value)
+                || IS_HEAP(*value, BRD_HEAP_LIST)
+                || IS_HEAP(*value, BRD_HEAP_DICT)
+                || IS_HEAP(*value, BRD_HEAP_SET)
+                || IS_HEAP(*value, BRD_HEAP_ARRAY)
+                || IS_HEAP(*value, BRD_HEAP_RANGE);
+}
+
+/*
+ * Put the item at *pos into out and advance *pos, or return false once
+ * there are no items left. Dicts and sets give their keys, skipping over
+ * removed entries. Lengths are checked every time since the loop body
+ * can change what it iterates over.
+ */
+int
+brd_value_iter_next(struct brd_value *value, size_t *pos, struct brd_value *out)
+{
+        struct brd_value_dict *dict;
+
+        if (IS_HEAP(*value, BRD_HEAP_LIST)) {
+                if (*pos >= value->as.heap->as.list->length) {
+                        return false;
+                }
+                *out = brd_value_list_get(value->as.heap->as.list, (*pos)++);
+                return true;
+        } else if (IS_HEAP(*value, BRD_HEAP_RANGE)) {
+                if (*pos >= value->as.heap->as.range->length) {
+                        return false;
+                }
+                out->vtype = BRD_VAL_NUM;
+                out->as.num = brd_value_range_get(value->as.heap->as.range, (*pos)++);
+                return true;
+        } else if (IS_HEAP(*value, BRD_HEAP_DICT) || IS_HEAP(*value, BRD_HEAP_SET)) {
+                dict = IS_HEAP(*value, BRD_HEAP_SET)
+                        ? &value->as.heap->as.set->dict
+                        : value->as.heap->as.dict;
+                /* entries can't move while a loop is part way through them */
+                if (*pos == 0) {
+                        dict->iterators++;
+                }
+                while (*pos < dict->length && IS_VAL(dict->entries[*pos].value, BRD_VAL_UNIT)) {
+                        (*pos)++;
+                }
+                if (*pos >= dict->length) {
+                        dict->iterators--;
+                        return false;
+                }
+                *out = dict->entries[(*pos)++].key;
+                return true;
+        } else if (IS_HEAP(*value, BRD_HEAP_ARRAY)) {
+                if (*pos >= value->as.heap->as.array->length) {
+                        return false;
+                }
+                brd_value_array_get(value->as.heap->as.array, (*pos)++, out);
+                return true;
+        }
+
+        /* strings index to shared single character strings */
+        if (*pos >= STRING_LENGTH(*value)) {
+                return false;
+        }
+        *out = *value;
+        brd_value_index(out, (*pos)++);
+        return true;
+}
+
+int
+brd_comparison_eq(struct brd_comparison cmp)
+{
+        return cmp.is_ord ? cmp.cmp == 0 : cmp.cmp;
+}
+
+void
+brd_value_debug(struct brd_value *value)
+{
+        switch (value->vtype) {
+        case BRD_VAL_NUM:
+                printf("%.10Lg", value->as.num);
+                break;
+        case BRD_VAL_STRING:
+                printf("\"%s\"", value->as.string->s);
+                break;
+        case BRD_VAL_SMALL_STRING:
+                printf("\"%s\"", value->as.small);
+                break;
+        case BRD_VAL_BOOL:
+                printf("%s", value->as.boolean ? "true" : "false");
+                break;
+        case BRD_VAL_UNIT:
+                printf("unit");
+                break;
+        case BRD_VAL_BUILTIN:
+                printf("<< builtin: %s >>", builtin_name[value->as.builtin]);
+                break;
+        case BRD_VAL_METHOD:
+                printf("<< method >>");
+                break;
+        case BRD_VAL_HEAP:
+                switch (value->as.heap->htype) {
+                case BRD_HEAP_STRING:
+                        printf("\"%s\"", AS_STRING(*value)->s);
+                        break;
+                case BRD_HEAP_LIST:
+                        printf("[ ");
+                        for (size_t i = 0; i < value->as.heap->as.list->length; i++) {
+                                struct brd_value item = brd_value_list_get(
+                                        value->as.heap->as.list, i
+                                );
+                                brd_value_debug(&item);
+                                if (i < value->as.heap->as.list->length - 1) {
+                                        printf(",");
+                                }
+                                printf(" ");
+                        }
+                        printf("]");
+                        break;
+                case BRD_HEAP_CLOSURE:
+                        printf("<< closure >>");
+                        break;
+                case BRD_HEAP_CLASS:
+                        printf("<< class >>");
+                        break;
+                case BRD_HEAP_OBJECT:
+                        printf("<< object >>");
+                        break;
+                case BRD_HEAP_DICT:
+                        printf("<< dict >>");
+                        break;
+                case BRD_HEAP_ARRAY:
+                        printf("<< array >>");
+                        break;
+                case BRD_HEAP_PQUEUE:
+                        printf("<< heap >>");
+                        break;
+                case BRD_HEAP_SET:
+                        printf("<< set >>");
+                        break;
+                case BRD_HEAP_RANGE:
+                        printf("<< range >>");
+                        break;
+                }
+        }
+}
+
+int brd_value_is_string(struct brd_value *value)
+{
+        return IS_STRING(*value);
+}
+
+void
+brd_value_coerce_num(struct brd_value *value)
+{
+        switch (value->vtype) {
+        case BRD_VAL_NUM:
+                break;
+        case BRD_VAL_STRING:
+        case BRD_VAL_SMALL_STRING:
+                value->as.num = brd_value_parse_num(value);
+                break;
+        case BRD_VAL_BOOL:
+                value->as.num = value->as.boolean ? 1 : 0;
+                break;
+        case BRD_VAL_UNIT:
+                value->as.num = 0;
+                break;
+        case BRD_VAL_BUILTIN:
+                BARF("builtin functions can't be coerced to a number");
+                break;
+        case BRD_VAL_METHOD:
+                BARF("can't coerce a method into a number");
+                break;
+        case BRD_VAL_HEAP:
+                switch (value->as.heap->htype) {
+                case BRD_HEAP_STRING:
+                        value->as.num = brd_value_parse_num(value);
+                        break;
+                case BRD_HEAP_LIST:
+                        BARF("can't coerce a list to a number");
+                        break;
+                case BRD_HEAP_CLOSURE:
+                        BARF("can't coerce a closure to a number");
+                        break;
+                case BRD_HEAP_CLASS:
+                        BARF("can't coerce a class into a number");
+                        break;
+                case BRD_HEAP_OBJECT:
+                        BARF("can't coerce an object into a number");
+                        break;
+                case BRD_HEAP_DICT:
+                        BARF("can't coerce a dict into a number");
+                        break;
+                case BRD_HEAP_ARRAY:
+                        BARF("can't coerce an array into a number");
+                        break;
+                case BRD_HEAP_PQUEUE:
+                        BARF("can't coerce a heap into a number");
+                        break;
+                case BRD_HEAP_SET:
+                        BARF("can't coerce a set into a number");
+                        break;
+                case BRD_HEAP_RANGE:
+                        BARF("can't coerce a range into a number");
+                }
+                break;
+        }
+        value->vtype = BRD_VAL_NUM;
+}
+
+/*
+ * Write num into buf (which must have room for SMALL_STRING_MAX + 1 chars)
+ * the same way %Lg would, returning the length
+ */
+size_t
+brd_value_format_num(long double num, char *buf)
+{
+        /* integers below 1e6 come out of %Lg unchanged, so skip printf */
+        if (num > -1e6L && num < 1e6L && num == (long)num) {
+                char digits[8];
+                long n = num;
+                size_t length = 0, i = 0;
+
+                if (signbit(num)) {
+                        buf[length++] = '-';
+                        n = -n;
+                }
+                do {
+                        digits[i++] = '0' + n % 10;
+                        n /= 10;
+                } while (n > 0);
+                while (i > 0) {
+                        buf[length++] = digits[--i];
+                }
+                buf[length] = '\0';
+                return length;
+        }
+
+        /* %Lg never needs more than 14 characters */
+        return snprintf(buf, SMALL_STRING_MAX + 1, "%Lg", num);
+}
+
+int
+brd_value_coerce_string(struct brd_value *value)
+{
+        /* return true if new allocation was made */
         char *string = "";
+        char num[SMALL_STRING_MAX + 1];
+        size_t length;
+
         switch (value->vtype) {
         case BRD_VAL_NUM:
-                value->vtype = BRD_VAL_HEAP;
-                string = malloc(sizeof(char) * 50); /* that's enough, right? */
-                sprintf(string, "%Lg", value->as.num);
-                value->as.heap = brd_heap_new(BRD_HEAP_STRING);
-                brd_value_string_init(value->as.heap->as.string, string);
-                return true;
+                if (value->as.num >= 0 && value->as.num < INT_STRINGS
+                                && value->as.num == (int)value->as.num
+                                && !signbit(value->as.num)) {
+                        value->vtype = BRD_VAL_STRING;
+                        value->as.string = &int_strings[(int)value->as.num];
+                        return false;
+                }
+                length = brd_value_format_num(value->as.num, num);
+                brd_value_small_string(value, num, length);
+                return false;
         case BRD_VAL_STRING:
+        case BRD_VAL_SMALL_STRING:
                 return false;
         case BRD_VAL_BOOL:
                 value->vtype = BRD_VAL_STRING;
@@ -702,6 +1888,26 @@ brd_value_coerce_string(struct brd_value *value)
                         value->as.heap = brd_heap_new(BRD_HEAP_STRING);
                         brd_value_string_init(value->as.heap->as.string, string);
                         return true;
+                case BRD_HEAP_ARRAY:
+                        string = brd_value_array_to_string(value->as.heap->as.array);
+                        value->vtype = BRD_VAL_HEAP;
+                        value->as.heap = brd_heap_new(BRD_HEAP_STRING);
+                        brd_value_string_init(value->as.heap->as.string, string);
+                        return true;
+                case BRD_HEAP_PQUEUE:
+                        value->vtype = BRD_VAL_STRING;
+                        value->as.string = &pqueue_string;
+                        return false;
+                case BRD_HEAP_SET:
+                        string = brd_value_set_to_string(value->as.heap->as.set);
+                        value->vtype = BRD_VAL_HEAP;
+                        value->as.heap = brd_heap_new(BRD_HEAP_STRING);
+                        brd_value_string_init(value->as.heap->as.string, string);
+                        return true;
+                case BRD_HEAP_RANGE:
+                        value->vtype = BRD_VAL_STRING;
+                        value->as.string = &range_string;
+                        return false;
                 }
                 break;
         }
@@ -725,22 +1931,19 @@ int
 brd_value_index(struct brd_value *value, intmax_t idx)
 {
         if IS_STRING(*value) {
-                struct brd_value_string *string = AS_STRING(*value);
-                char *c;
+                size_t length = STRING_LENGTH(*value);
+                unsigned char c;
 
-                idx = brd_value_index_clamp(idx, string->length);
-                if (string->length == 0) {
+                idx = brd_value_index_clamp(idx, length);
+                if (length == 0) {
                         value->vtype = BRD_VAL_UNIT;
                         return false;
                 }
 
-                c = malloc(2);
-                c[0] = string->s[idx];
-                c[1] = '\0';
-                value->vtype = BRD_VAL_HEAP;
-                value->as.heap = brd_heap_new(BRD_HEAP_STRING);
-                brd_value_string_init(value->as.heap->as.string, c);
-                return true;
+                c = STRING_CHARS(*value)[idx];
+                value->vtype = BRD_VAL_STRING;
+                value->as.string = &char_strings[c];
+                return false;
         } else if (IS_HEAP(*value, BRD_HEAP_LIST)) {
                 struct brd_value_list *list = value->as.heap->as.list;
                 idx = brd_value_index_clamp(idx, list->length);
@@ -748,14 +1951,129 @@ brd_value_index(struct brd_value *value, intmax_t idx)
                         value->vtype = BRD_VAL_UNIT;
                         return false;
                 } else {
-                        *value = list->items[idx];
+                        *value = brd_value_list_get(list, idx);
                         return false;
                 }
-        } else {
-                BARF("attempted to index a non-indexable");
-                return -1;
-        }
-}
+        } else if (IS_HEAP(*value, BRD_HEAP_ARRAY)) {
+                struct brd_value_array *array = value->as.heap->as.array;
+                if (array->length == 0) {
+                        value->vtype = BRD_VAL_UNIT;
+                } else {
+                        idx = brd_value_index_clamp(idx, array->length);
+                        brd_value_array_get(array, idx, value);
+                }
+                return false;
+        } else if (IS_HEAP(*value, BRD_HEAP_RANGE)) {
+                struct brd_value_range *range = value->as.heap->as.range;
+                if (range->length == 0) {
+                        value->vtype = BRD_VAL_UNIT;
+                } else {
+                        idx = brd_value_index_clamp(idx, range->length);
+                        value->vtype = BRD_VAL_NUM;
+                        value->as.num = brd_value_range_get(range, idx);
+                }
+                return false;
+        } else {
+                BARF("attempted to index a non-indexable");
+                return -1;
+        }
+}
+
+/* slice bounds are clamped rather than wrapped, negative ones count from the end */
+static size_t
+brd_value_slice_clamp(intmax_t idx, size_t length)
+{
+        if (idx < 0) {
+                idx += length;
+        }
+        if (idx < 0) {
+                return 0;
+        } else if ((size_t)idx > length) {
+                return length;
+        }
+        return idx;
+}
+
+/*
+ * Slicing a long string or a list doesn't copy anything:
+ * string slices are ropes which refer to the sliced string,
+ * and list slices share the sliced list's buffer
+ */
+int
+brd_value_slice(struct brd_value *value, intmax_t start, intmax_t end)
+{
+        struct brd_heap_entry *new;
+        size_t length, from, to;
+
+        if (IS_STRING(*value)) {
+                length = STRING_LENGTH(*value);
+        } else if (IS_HEAP(*value, BRD_HEAP_LIST)) {
+                length = value->as.heap->as.list->length;
+        } else {
+                BARF("attempted to slice a non-sliceable");
+                return -1;
+        }
+
+        from = brd_value_slice_clamp(start, length);
+        to = brd_value_slice_clamp(end, length);
+        if (to < from) {
+                to = from;
+        }
+
+        if (IS_STRING(*value)) {
+                struct brd_value_string *string, *parent;
+
+                if (from == 0 && to == length) {
+                        return false;
+                } else if (to - from <= SMALL_STRING_MAX) {
+                        char small[SMALL_STRING_MAX + 1];
+
+                        memcpy(small, STRING_CHARS(*value) + from, to - from);
+                        brd_value_small_string(value, small, to - from);
+                        return false;
+                }
+
+                new = brd_heap_new(BRD_HEAP_STRING);
+                string = new->as.string;
+                string->s = NULL;
+                string->length = to - from;
+                string->num_state = BRD_STRING_NUM_UNKNOWN;
+                string->hash = 0;
+                string->rope = malloc(sizeof(struct brd_value_rope));
+                string->rope->right.vtype = BRD_VAL_UNIT;
+
+                /* a slice of a slice refers to the original string */
+                parent = AS_ROPE_STRING(*value);
+                if (parent->rope != NULL && IS_VAL(parent->rope->right, BRD_VAL_UNIT)) {
+                        string->rope->left = parent->rope->left;
+                        string->rope->start = parent->rope->start + from;
+                } else {
+                        string->rope->left = *value;
+                        string->rope->start = from;
+                }
+        } else {
+                struct brd_value_list *list = value->as.heap->as.list;
+
+                new = brd_heap_new(BRD_HEAP_LIST);
+                if (from == to) {
+                        brd_value_list_init(new->as.list);
+                } else {
+                        __atomic_add_fetch(&list->buffer->refs, 1, __ATOMIC_ACQ_REL);
+                        new->as.list->buffer = list->buffer;
+                        new->as.list->kind = list->kind;
+                        brd_value_list_set_start(
+                                new->as.list,
+                                brd_value_list_start(list)
+                                        + from * brd_value_list_item_size(list)
+                        );
+                        new->as.list->length = to - from;
+                }
+        }
+
+        value->vtype = BRD_VAL_HEAP;
+        value->as.heap = new;
+        return true;
+}
 
 int
 brd_value_truthify(struct brd_value *value)
@@ -765,6 +2083,8 @@ brd_value_truthify(struct brd_value *value)
                 return value->as.num != 0;
         case BRD_VAL_STRING:
                 return value->as.string->length > 0;
+        case BRD_VAL_SMALL_STRING:
+                return value->small_length > 0;
         case BRD_VAL_BOOL:
                 return value->as.boolean;
         case BRD_VAL_UNIT:
@@ -788,6 +2108,14 @@ brd_value_truthify(struct brd_value *value)
                 case BRD_HEAP_DICT:
                         // TODO: truthy iff not empty
                         return true;
+                case BRD_HEAP_ARRAY:
+                        return value->as.heap->as.array->length > 0;
+                case BRD_HEAP_PQUEUE:
+                        return value->as.heap->as.pqueue->length > 0;
+                case BRD_HEAP_SET:
+                        return value->as.heap->as.set->dict.size > 0;
+                case BRD_HEAP_RANGE:
+                        return value->as.heap->as.range->length > 0;
                 }
         }
         BARF("what?");
@@ -796,18 +2124,51 @@ brd_value_truthify(struct brd_value *value)
 
 // https://stackoverflow.com/questions/1903954/is-there-a-standard-sign-function-signum-sgn-in-c-c
 #define signum(a) ((0 < (a)) - ((a) < 0)) //why isn't this in math.h?
+
+/* strcmp, but using the lengths we already know */
+static int
+brd_value_string_compare(struct brd_value *a, struct brd_value *b)
+{
+        size_t la = STRING_LENGTH(*a), lb = STRING_LENGTH(*b);
+        int cmp = memcmp(STRING_CHARS(*a), STRING_CHARS(*b), la < lb ? la : lb);
+
+        return cmp != 0 ? signum(cmp) : signum((long)la - (long)lb);
+}
+
+int
+brd_value_equals(struct brd_value *a, struct brd_value *b)
+{
+        if (IS_STRING(*a) && IS_STRING(*b)) {
+                size_t length = STRING_LENGTH(*a);
+
+                if (length != STRING_LENGTH(*b)) {
+                        return false;
+                }
+                if (!IS_VAL(*a, BRD_VAL_SMALL_STRING) && !IS_VAL(*b, BRD_VAL_SMALL_STRING)) {
+                        unsigned long ha = AS_ROPE_STRING(*a)->hash;
+                        unsigned long hb = AS_ROPE_STRING(*b)->hash;
+                        if (ha != 0 && hb != 0 && ha != hb) {
+                                return false;
+                        }
+                }
+                return memcmp(STRING_CHARS(*a), STRING_CHARS(*b), length) == 0;
+        }
+
+        return brd_comparison_eq(brd_value_compare(a, b));
+}
+
 struct brd_comparison
 brd_value_compare(struct brd_value *a, struct brd_value *b)
 {
         struct brd_comparison result;
 
         if (IS_STRING(*a)) {
-                char *sa = AS_STRING(*a)->s;
+                char *sa = STRING_CHARS(*a);
                 if (IS_STRING(*b)) {
-                        result.cmp = signum(strcmp(sa, AS_STRING(*b)->s));
+                        result.cmp = brd_value_string_compare(a, b);
                         result.is_ord = true;
                 } else if (IS_VAL(*b, BRD_VAL_NUM)) {
-                        long double da = strtold(sa, NULL);
+                        long double da = brd_value_parse_num(a);
                         result.cmp = signum(da - b->as.num);
                         result.is_ord = true;
                 } else if (IS_VAL(*b, BRD_VAL_BOOL)) {
@@ -823,7 +2184,7 @@ brd_value_compare(struct brd_value *a, struct brd_value *b)
         } else if (IS_VAL(*a, BRD_VAL_NUM)) {
                 long double da = a->as.num;
                 if (IS_STRING(*b)) {
-                        long double db = strtold(AS_STRING(*b)->s, NULL);
+                        long double db = brd_value_parse_num(b);
                         result.cmp = signum(da - db);
                         result.is_ord = true;
                 } else if (IS_VAL(*b, BRD_VAL_NUM)) {
@@ -842,7 +2203,7 @@ brd_value_compare(struct brd_value *a, struct brd_value *b)
         } else if (IS_VAL(*a, BRD_VAL_BOOL)) {
                 int ba = a->as.boolean;
                 if (IS_STRING(*b)) {
-                        result.cmp = strcmp(ba ? "true" : "false", AS_STRING(*b)->s);
+                        result.cmp = strcmp(ba ? "true" : "false", STRING_CHARS(*b));
                         result.is_ord = true;
                 } else if (IS_VAL(*b, BRD_VAL_NUM)) {
                         result.cmp = signum(ba - b->as.num);
@@ -859,7 +2220,7 @@ brd_value_compare(struct brd_value *a, struct brd_value *b)
                 }
         } else if (IS_VAL(*a, BRD_VAL_UNIT)) {
                 if (IS_STRING(*b)) {
-                        result.cmp = strcmp("unit", AS_STRING(*b)->s);
+                        result.cmp = strcmp("unit", STRING_CHARS(*b));
                         result.is_ord = true;
                 } else if (IS_VAL(*b, BRD_VAL_NUM)) {
                         result.cmp = signum(-b->as.num);
@@ -910,346 +2271,1392 @@ brd_value_compare(struct brd_value *a, struct brd_value *b)
 }
 #undef signum
 
-void
+/* return true if a new allocation was made */
+int
 brd_value_concat(struct brd_value *a, struct brd_value *b)
 {
-        struct brd_heap_entry *new;
-        if (IS_HEAP(*a, BRD_HEAP_LIST)) {
-                struct brd_value_list *list_a = a->as.heap->as.list;
+        struct brd_heap_entry *new;
+        if (IS_HEAP(*a, BRD_HEAP_LIST)) {
+                struct brd_value_list *list_a = a->as.heap->as.list;
+
+                struct brd_value_list *list_b = NULL;
+                enum brd_list_kind kind = list_a->kind;
+                size_t length = list_a->length + 1;
+
+                if (IS_HEAP(*b, BRD_HEAP_LIST)) {
+                        list_b = b->as.heap->as.list;
+                        length = list_a->length + list_b->length;
+                        if (list_b->kind == BRD_LIST_VALUES) {
+                                kind = BRD_LIST_VALUES;
+                        }
+                } else if (!IS_VAL(*b, BRD_VAL_NUM)) {
+                        kind = BRD_LIST_VALUES;
+                }
+
+                new = brd_heap_new(BRD_HEAP_LIST);
+                brd_value_list_init_with_capacity(new->as.list, kind, length);
+                for (size_t i = 0; i < list_a->length; i++) {
+                        struct brd_value item = brd_value_list_get(list_a, i);
+                        brd_value_list_push(new->as.list, &item);
+                }
+                if (list_b == NULL) {
+                        brd_value_list_push(new->as.list, b);
+                } else {
+                        for (size_t i = 0; i < list_b->length; i++) {
+                                struct brd_value item = brd_value_list_get(list_b, i);
+                                brd_value_list_push(new->as.list, &item);
+                        }
+                }
+        } else {
+                int free_a, free_b;
+                size_t length;
+
+                free_a = brd_value_coerce_string(a);
+                free_b = brd_value_coerce_string(b);
+                length = STRING_LENGTH(*a) + STRING_LENGTH(*b);
+
+                if (length <= SMALL_STRING_MAX) {
+                        char small[SMALL_STRING_MAX + 1];
+                        size_t length_a = STRING_LENGTH(*a);
+
+                        memcpy(small, STRING_CHARS(*a), length_a);
+                        memcpy(small + length_a, STRING_CHARS(*b), length - length_a);
+                        if (free_a) {
+                                brd_heap_destroy(a->as.heap);
+                        }
+                        if (free_b) {
+                                brd_heap_destroy(b->as.heap);
+                        }
+                        brd_value_small_string(a, small, length);
+                        return false;
+                }
+
+                new = brd_heap_new(BRD_HEAP_STRING);
+                if (length >= ROPE_THRESHOLD) {
+                        /* the rope holds on to the operands, so the gc owns them now */
+                        if (free_a) {
+                                brd_vm_allocate(a->as.heap);
+                        }
+                        if (free_b) {
+                                brd_vm_allocate(b->as.heap);
+                        }
+                        new->as.string->s = NULL;
+                        new->as.string->length = length;
+                        new->as.string->num_state = BRD_STRING_NUM_UNKNOWN;
+                        new->as.string->hash = 0;
+                        new->as.string->rope = malloc(sizeof(struct brd_value_rope));
+                        new->as.string->rope->left = *a;
+                        new->as.string->rope->right = *b;
+                } else {
+                        char *new_string = malloc(length + 1);
+                        size_t length_a = STRING_LENGTH(*a);
+
+                        memcpy(new_string, STRING_CHARS(*a), length_a);
+                        strcpy(new_string + length_a, STRING_CHARS(*b));
+                        brd_value_string_init(new->as.string, new_string);
+
+                        if (free_a) {
+                                brd_heap_destroy(a->as.heap);
+                        }
+                        if (free_b) {
+                                brd_heap_destroy(b->as.heap);
+                        }
+                }
+        }
+
+        a->vtype = BRD_VAL_HEAP;
+        a->as.heap = new;
+        return true;
+}
+
+static int
+_builtin_write(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        if (out != NULL) {
+                out->vtype = BRD_VAL_UNIT;
+        }
+
+        for (size_t i = 0; i < num_args; i++) {
+                int new;
+
+                if (IS_VAL(args[i], BRD_VAL_NUM)) {
+                        char num[SMALL_STRING_MAX + 1];
+                        size_t length = brd_value_format_num(args[i].as.num, num);
+                        fwrite(num, sizeof(char), length, stdout);
+                        continue;
+                }
+
+                new = brd_value_coerce_string(&args[i]);
+                fwrite(STRING_CHARS(args[i]), sizeof(char), STRING_LENGTH(args[i]), stdout);
+                if (new) {
+                        brd_heap_destroy(args[i].as.heap);
+                }
+        }
+
+        return false;
+}
+
+static int
+_builtin_writeln(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        _builtin_write(args, num_args, out);
+        printf("\n");
+        return false;
+}
+
+static int
+_builtin_readln(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        ssize_t n;
+        size_t i;
+        char *str;
+
+        (void)args;
+        if (num_args > 0) {
+                BARF("readln accepts no arguments");
+        }
+
+
+        str = NULL;
+        if ((n = getline(&str, &i, stdin)) == -1) {
+                free(str);
+                out->vtype = BRD_VAL_UNIT;
+                return false;
+        } else {
+                str[n-1] = '\0'; /* remove newline */
+                if (n - 1 <= SMALL_STRING_MAX) {
+                        brd_value_small_string(out, str, n - 1);
+                        free(str);
+                        return false;
+                }
+                out->vtype = BRD_VAL_HEAP;
+                out->as.heap = brd_heap_new(BRD_HEAP_STRING);
+                brd_value_string_init(out->as.heap->as.string, str);
+                return true;
+        }
+}
+
+static int
+_builtin_length(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        if (num_args != 1) {
+                BARF("length accepts exactly 1 argument");
+        }
+
+        out->vtype = BRD_VAL_NUM;
+
+        if (IS_STRING(args[0])) {
+                out->as.num = STRING_LENGTH(args[0]);
+        } else if (IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                out->as.num = args[0].as.heap->as.list->length;
+        } else if (IS_HEAP(args[0], BRD_HEAP_DICT)) {
+                out->as.num = args[0].as.heap->as.dict->size;
+        } else if (IS_HEAP(args[0], BRD_HEAP_ARRAY)) {
+                out->as.num = args[0].as.heap->as.array->length;
+        } else if (IS_HEAP(args[0], BRD_HEAP_PQUEUE)) {
+                out->as.num = args[0].as.heap->as.pqueue->length;
+        } else if (IS_HEAP(args[0], BRD_HEAP_SET)) {
+                out->as.num = args[0].as.heap->as.set->dict.size;
+        } else if (IS_HEAP(args[0], BRD_HEAP_RANGE)) {
+                out->as.num = args[0].as.heap->as.range->length;
+        }
+
+        return false;
+}
+
+static int
+_builtin_typeof(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+
+        if (num_args != 1) {
+                BARF("typeof accepts exactly 1 argument");
+        }
+
+        out->vtype = BRD_VAL_STRING;
+        switch (args[0].vtype) {
+        case BRD_VAL_NUM:
+                out->as.string = &number_string;
+                break;
+        case BRD_VAL_STRING:
+        case BRD_VAL_SMALL_STRING:
+                out->as.string = &string_string;
+                break;
+        case BRD_VAL_BOOL:
+                out->as.string = &boolean_string;
+                break;
+        case BRD_VAL_UNIT:
+                out->as.string = &unit_string;
+                break;
+        case BRD_VAL_BUILTIN:
+                out->as.string = &builtin_string[args[0].as.builtin];
+                break;
+        case BRD_VAL_METHOD:
+                out->as.string = &method_string;
+                break;
+        case BRD_VAL_HEAP:
+                out->as.string = brd_heap_type_string(args[0].as.heap->htype);
+                break;
+        }
+
+        return false;
+}
+
+static int
+_builtin_system(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        size_t len;
+        char *cmd;
+        int *malloced = malloc(sizeof(int) * num_args);
+
+        for(size_t i = 0; i < num_args; i++) {
+                malloced[i] = brd_value_coerce_string(&args[i]);
+        }
+
+        len = 1;
+        for (size_t i = 0; i < num_args; i++) {
+                len += STRING_LENGTH(args[i]);
+        }
+        cmd = malloc(sizeof(char) * len);
+        cmd[0] = '\0';
+        for (size_t i = 0; i < num_args; i++) {
+                strcat(cmd, STRING_CHARS(args[i]));
+        }
+
+        out->vtype = BRD_VAL_NUM;
+        out->as.num = system(cmd);
+
+        for (size_t i = 0; i < num_args; i++) {
+                if (malloced[i]) {
+                        brd_heap_destroy(args[i].as.heap);
+                }
+        }
+        free(malloced);
+        free(cmd);
+        return false;
+}
+
+static int
+_builtin_string(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        if (num_args != 1) {
+                BARF("@string accepts exactly one argument");
+        }
+
+        *out = args[0];
+        return brd_value_coerce_string(out);
+}
+
+static int
+_builtin_push(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_list *list;
+        if (num_args == 0) {
+                BARF("@push should be given at least one argument");
+        } else if (!IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                BARF("first argument to @push should be a list");
+        }
+
+        list = args[0].as.heap->as.list;
+        for (size_t i = 1; i < num_args; i++) {
+                brd_value_list_push(list, &args[i]);
+        }
+
+        out->vtype = BRD_VAL_UNIT;
+        return false;
+}
+
+static int
+_builtin_insert(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_list *list;
+        size_t idx;
+        long double num;
+
+        if (num_args != 3) {
+                BARF("@insert accepts exactly 3 arguments");
+        } else if (!IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                BARF("first argument to @insert should be a list");
+        }
+
+        list = args[0].as.heap->as.list;
+
+        brd_value_coerce_num(&args[2]);
+        num = floorl(args[2].as.num);
+        if (num < 0) {
+                BARF("index for @insert cannot be negative");
+        }
+        idx = num;
+
+        if (list->length <= idx) {
+                struct brd_value unit;
+                unit.vtype = BRD_VAL_UNIT;
+
+                for (size_t i = list->length; i < idx; i++) {
+                        brd_value_list_push(list, &unit);
+                }
+                brd_value_list_push(list, &args[1]);
+        } else {
+                brd_value_list_insert(list, idx, &args[1]);
+        }
+
+        out->vtype = BRD_VAL_UNIT;
+        return false;
+}
+
+static int
+_builtin_pushfront(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_list *list;
+        if (num_args == 0) {
+                BARF("@pushfront should be given at least one argument");
+        } else if (!IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                BARF("first argument to @pushfront should be a list");
+        }
+
+        /* the arguments end up in the same order they were given in */
+        list = args[0].as.heap->as.list;
+        for (size_t i = num_args - 1; i > 0; i--) {
+                brd_value_list_push_front(list, &args[i]);
+        }
+
+        out->vtype = BRD_VAL_UNIT;
+        return false;
+}
+
+static int
+_builtin_pop(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_list *list;
+
+        if (num_args != 1) {
+                BARF("@pop accepts exactly 1 argument");
+        } else if (!IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                BARF("argument to @pop should be a list");
+        }
+
+        list = args[0].as.heap->as.list;
+        if (list->length == 0) {
+                out->vtype = BRD_VAL_UNIT;
+        } else {
+                brd_value_list_remove(list, list->length - 1, out);
+        }
+        return false;
+}
+
+static int
+_builtin_popfront(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_list *list;
+
+        if (num_args != 1) {
+                BARF("@popfront accepts exactly 1 argument");
+        } else if (!IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                BARF("argument to @popfront should be a list");
+        }
+
+        list = args[0].as.heap->as.list;
+        if (list->length == 0) {
+                out->vtype = BRD_VAL_UNIT;
+        } else {
+                brd_value_list_remove(list, 0, out);
+        }
+        return false;
+}
+
+static int
+_builtin_remove(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_list *list;
+
+        if (num_args != 2) {
+                BARF("@remove accepts exactly 2 arguments");
+        } else if (!IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                BARF("first argument to @remove should be a list");
+        }
+
+        list = args[0].as.heap->as.list;
+        if (list->length == 0) {
+                out->vtype = BRD_VAL_UNIT;
+                return false;
+        }
+
+        /* the index wraps around like it does when indexing */
+        brd_value_coerce_num(&args[1]);
+        brd_value_list_remove(
+                list,
+                brd_value_index_clamp(floorl(args[1].as.num), list->length),
+                out
+        );
+        return false;
+}
+
+/* whether a belongs after b, cmp is the comparator given to @sort if any */
+static int
+brd_value_sort_greater(struct brd_value *a, struct brd_value *b, struct brd_value *cmp)
+{
+        struct brd_comparison comparison;
+        struct brd_value pair[2], out;
+
+        if (cmp == NULL) {
+                comparison = brd_value_compare(a, b);
+                if (!comparison.is_ord) {
+                        BARF("@sort cannot order these values, give it a comparator");
+                }
+                return comparison.cmp > 0;
+        }
+
+        pair[0] = *a;
+        pair[1] = *b;
+        brd_vm_call(cmp, pair, 2, &out);
+        brd_value_coerce_num(&out);
+        return out.as.num > 0;
+}
+
+#define SORT_RUN 16
+
+/*
+ * Stable merge sort: insertion sort on short runs, then bottom up merges
+ * between items and scratch, which both have room for length values.
+ * The values are only ever copied within the two, so that they stay
+ * rooted while a comparator runs. Returns whichever holds the result.
+ */
+static struct brd_value *
+brd_value_sort(
+        struct brd_value *items,
+        struct brd_value *scratch,
+        size_t length,
+        struct brd_value *cmp)
+{
+        struct brd_value *src = items, *dst = scratch, *tmp, swap;
+
+        for (size_t lo = 0; lo < length; lo += SORT_RUN) {
+                size_t hi = lo + SORT_RUN < length ? lo + SORT_RUN : length;
+
+                for (size_t i = lo + 1; i < hi; i++) {
+                        for (size_t j = i; j > lo && brd_value_sort_greater(
+                                        &items[j - 1], &items[j], cmp); j--) {
+                                swap = items[j - 1];
+                                items[j - 1] = items[j];
+                                items[j] = swap;
+                        }
+                }
+        }
+
+        for (size_t width = SORT_RUN; width < length; width *= 2) {
+                for (size_t lo = 0; lo < length; lo += 2 * width) {
+                        size_t mid = lo + width < length ? lo + width : length;
+                        size_t hi = mid + width < length ? mid + width : length;
+                        size_t i = lo, j = mid, k = lo;
+
+                        /* ties take from the left to keep the sort stable */
+                        while (i < mid && j < hi) {
+                                if (brd_value_sort_greater(&src[i], &src[j], cmp)) {
+                                        dst[k++] = src[j++];
+                                } else {
+                                        dst[k++] = src[i++];
+                                }
+                        }
+                        while (i < mid) {
+                                dst[k++] = src[i++];
+                        }
+                        while (j < hi) {
+                                dst[k++] = src[j++];
+                        }
+                }
+                tmp = src;
+                src = dst;
+                dst = tmp;
+        }
+
+        return src;
+}
+
+static int
+_builtin_sort(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_list *list;
+        struct brd_value *cmp = NULL, *items, *sorted, scratch;
+        size_t length;
+
+        if (num_args != 1 && num_args != 2) {
+                BARF("@sort accepts 1 or 2 arguments");
+        } else if (!IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                BARF("first argument to @sort should be a list");
+        }
+
+        list = args[0].as.heap->as.list;
+        length = list->length;
+        out->vtype = BRD_VAL_UNIT;
+        if (length < 2) {
+                return false;
+        }
+
+        if (num_args == 2) {
+                /*
+                 * the comparator can allocate and so collect garbage, the
+                 * scratch space is a rooted list so that the items in it
+                 * survive even if the comparator changes this list
+                 */
+                cmp = &args[1];
+                scratch.vtype = BRD_VAL_HEAP;
+                scratch.as.heap = brd_heap_new(BRD_HEAP_LIST);
+                brd_value_list_init_with_capacity(
+                        scratch.as.heap->as.list, BRD_LIST_VALUES, 2 * length
+                );
+                scratch.as.heap->as.list->length = 2 * length;
+                brd_vm_allocate(scratch.as.heap);
+                items = scratch.as.heap->as.list->as.values;
+        } else {
+                items = malloc(2 * length * sizeof(*items));
+        }
+
+        for (size_t i = 0; i < length; i++) {
+                items[i] = items[length + i] = brd_value_list_get(list, i);
+        }
+        if (cmp != NULL) {
+                brd_vm_root(&scratch);
+        }
+
+        sorted = brd_value_sort(items, items + length, length, cmp);
+        if (list->length != length) {
+                BARF("list was modified while @sort was sorting it");
+        }
+        for (size_t i = 0; i < length; i++) {
+                brd_value_list_set(list, i, &sorted[i]);
+        }
+
+        if (cmp != NULL) {
+                brd_vm_unroot(1);
+        } else {
+                free(items);
+        }
+        return false;
+}
+
+/*
+ * The higher order builtins take a list and something to call on its
+ * items. The length is read on every iteration in case the callee
+ * changes the list.
+ */
+static struct brd_value_list *
+brd_value_list_fn_args(struct brd_value *args, size_t num_args, const char *name)
+{
+        if (num_args != 2) {
+                BARFA("%s accepts exactly 2 arguments", name);
+        } else if (!IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                BARFA("first argument to %s should be a list", name);
+        }
+        return args[0].as.heap->as.list;
+}
+
+/* out is a new list, rooted so that it survives the calls that fill it */
+static struct brd_value_list *
+brd_value_list_fn_result(struct brd_value *out, size_t capacity)
+{
+        out->vtype = BRD_VAL_HEAP;
+        out->as.heap = brd_heap_new(BRD_HEAP_LIST);
+        brd_value_list_init_with_capacity(out->as.heap->as.list, BRD_LIST_NUMS, capacity);
+        brd_vm_allocate(out->as.heap);
+        brd_vm_root(out);
+        return out->as.heap->as.list;
+}
+
+static int
+_builtin_map(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_list *list, *result;
+        struct brd_value item, value;
+
+        list = brd_value_list_fn_args(args, num_args, "@map");
+        result = brd_value_list_fn_result(out, list->length);
+        for (size_t i = 0; i < list->length; i++) {
+                item = brd_value_list_get(list, i);
+                brd_vm_call(&args[1], &item, 1, &value);
+                brd_value_list_push(result, &value);
+        }
+        brd_vm_unroot(1);
+        return false;
+}
+
+static int
+_builtin_filter(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_list *list, *result;
+        struct brd_value item, value;
+
+        list = brd_value_list_fn_args(args, num_args, "@filter");
+        result = brd_value_list_fn_result(out, list->length);
+        for (size_t i = 0; i < list->length; i++) {
+                /* the item is kept, so it has to outlive the call */
+                item = brd_value_list_get(list, i);
+                brd_vm_root(&item);
+                brd_vm_call(&args[1], &item, 1, &value);
+                brd_vm_unroot(1);
+                if (brd_value_truthify(&value)) {
+                        brd_value_list_push(result, &item);
+                }
+        }
+        brd_vm_unroot(1);
+        return false;
+}
+
+static int
+_builtin_reduce(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_list *list;
+        struct brd_value pair[2];
+        size_t i = 0;
+
+        if (num_args != 2 && num_args != 3) {
+                BARF("@reduce accepts 2 or 3 arguments");
+        } else if (!IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                BARF("first argument to @reduce should be a list");
+        }
+
+        /* without an initial value, the first item is used */
+        list = args[0].as.heap->as.list;
+        if (num_args == 3) {
+                *out = args[2];
+        } else if (list->length > 0) {
+                *out = brd_value_list_get(list, i++);
+        } else {
+                out->vtype = BRD_VAL_UNIT;
+        }
+
+        /*
+         * the accumulator is always either an argument or the value
+         * being returned when the gc can run, so it needn't be rooted
+         */
+        for (; i < list->length; i++) {
+                pair[0] = *out;
+                pair[1] = brd_value_list_get(list, i);
+                brd_vm_call(&args[1], pair, 2, out);
+        }
+        return false;
+}
+
+/* whether truthy results from f are counted for every item or any item */
+static int
+brd_value_list_quantify(struct brd_value *args, size_t num_args, int every, const char *name)
+{
+        struct brd_value_list *list;
+        struct brd_value item, value;
+
+        list = brd_value_list_fn_args(args, num_args, name);
+        for (size_t i = 0; i < list->length; i++) {
+                item = brd_value_list_get(list, i);
+                brd_vm_call(&args[1], &item, 1, &value);
+                if (brd_value_truthify(&value) != every) {
+                        return !every;
+                }
+        }
+        return every;
+}
+
+static int
+_builtin_any(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        out->vtype = BRD_VAL_BOOL;
+        out->as.boolean = brd_value_list_quantify(args, num_args, false, "@any");
+        return false;
+}
+
+static int
+_builtin_all(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        out->vtype = BRD_VAL_BOOL;
+        out->as.boolean = brd_value_list_quantify(args, num_args, true, "@all");
+        return false;
+}
+
+static int
+_builtin_foreach(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_list *list;
+        struct brd_value item;
+
+        list = brd_value_list_fn_args(args, num_args, "@foreach");
+        for (size_t i = 0; i < list->length; i++) {
+                item = brd_value_list_get(list, i);
+                brd_vm_call(&args[1], &item, 1, out);
+        }
+        out->vtype = BRD_VAL_UNIT;
+        return false;
+}
+
+static int
+_builtin_heap(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value key_fn;
+
+        if (num_args > 1) {
+                BARF("@heap accepts at most 1 argument");
+        }
+
+        if (num_args == 1) {
+                key_fn = args[0];
+        } else {
+                key_fn.vtype = BRD_VAL_UNIT;
+        }
+        out->vtype = BRD_VAL_HEAP;
+        out->as.heap = brd_heap_new(BRD_HEAP_PQUEUE);
+        brd_value_pqueue_init(out->as.heap->as.pqueue, &key_fn);
+        return true;
+}
+
+static struct brd_value_pqueue *
+brd_value_pqueue_arg(struct brd_value *args, size_t num_args, size_t expected, const char *name)
+{
+        if (num_args != expected) {
+                BARFA("%s accepts exactly %zu argument%s", name, expected, expected == 1 ? "" : "s");
+        } else if (!IS_HEAP(args[0], BRD_HEAP_PQUEUE)) {
+                BARFA("first argument to %s should be a heap", name);
+        }
+        return args[0].as.heap->as.pqueue;
+}
+
+static int
+_builtin_heappush(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_pqueue *pqueue;
+        struct brd_value key;
+
+        pqueue = brd_value_pqueue_arg(args, num_args, 2, "@heappush");
+        if (IS_VAL(pqueue->key_fn, BRD_VAL_UNIT)) {
+                key = args[1];
+        } else {
+                brd_vm_call(&pqueue->key_fn, &args[1], 1, &key);
+        }
+        brd_value_pqueue_push(pqueue, &key, &args[1]);
+
+        out->vtype = BRD_VAL_UNIT;
+        return false;
+}
+
+static int
+_builtin_heappop(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_pqueue *pqueue;
+
+        pqueue = brd_value_pqueue_arg(args, num_args, 1, "@heappop");
+        if (pqueue->length == 0) {
+                out->vtype = BRD_VAL_UNIT;
+        } else {
+                brd_value_pqueue_pop(pqueue, out);
+        }
+        return false;
+}
+
+static int
+_builtin_heappeek(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_pqueue *pqueue;
+
+        pqueue = brd_value_pqueue_arg(args, num_args, 1, "@heappeek");
+        if (pqueue->length == 0) {
+                out->vtype = BRD_VAL_UNIT;
+        } else {
+                *out = pqueue->entries[0].value;
+        }
+        return false;
+}
+
+static struct brd_value_set *
+brd_value_new_set(struct brd_value *out)
+{
+        out->vtype = BRD_VAL_HEAP;
+        out->as.heap = brd_heap_new(BRD_HEAP_SET);
+        brd_value_set_init(out->as.heap->as.set);
+        return out->as.heap->as.set;
+}
+
+static int
+_builtin_set(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_set *set;
+        struct brd_value item;
+
+        if (num_args > 1) {
+                BARF("@set accepts at most 1 argument");
+        }
+
+        set = brd_value_new_set(out);
+        if (num_args == 0) {
+                return true;
+        }
+
+        /* the items of a list, or a copy of another set */
+        if (IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                struct brd_value_list *list = args[0].as.heap->as.list;
+
+                for (size_t i = 0; i < list->length; i++) {
+                        item = brd_value_list_get(list, i);
+                        brd_value_set_add(set, &item);
+                }
+        } else if (IS_HEAP(args[0], BRD_HEAP_SET)) {
+                struct brd_value_dict *from = &args[0].as.heap->as.set->dict;
+
+                for (size_t i = 0; i < from->length; i++) {
+                        if (!IS_VAL(from->entries[i].value, BRD_VAL_UNIT)) {
+                                brd_value_set_add(set, &from->entries[i].key);
+                        }
+                }
+        } else {
+                BARF("@set expects a list or a set");
+        }
+        return true;
+}
+
+static struct brd_value_set *
+brd_value_set_arg(struct brd_value *arg, const char *name)
+{
+        if (!IS_HEAP(*arg, BRD_HEAP_SET)) {
+                BARFA("%s expects sets, see @set", name);
+        }
+        return arg->as.heap->as.set;
+}
+
+/* @has also checks for keys in a dict */
+static int
+_builtin_has(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        if (num_args != 2) {
+                BARF("@has accepts exactly 2 arguments");
+        }
+
+        out->vtype = BRD_VAL_BOOL;
+        if (IS_HEAP(args[0], BRD_HEAP_DICT)) {
+                out->as.boolean = brd_value_dict_get(args[0].as.heap->as.dict, &args[1]) != NULL;
+        } else {
+                out->as.boolean = brd_value_set_has(brd_value_set_arg(&args[0], "@has"), &args[1]);
+        }
+        return false;
+}
+
+static int
+_builtin_discard(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        if (num_args != 2) {
+                BARF("@discard accepts exactly 2 arguments");
+        }
+
+        out->vtype = BRD_VAL_BOOL;
+        out->as.boolean = brd_value_set_discard(brd_value_set_arg(&args[0], "@discard"), &args[1]);
+        return false;
+}
+
+/*
+ * The items of a which are (or with keep false, aren't) in b, or every item
+ * of both when union_b is true
+ */
+static int
+brd_value_set_combine(
+        struct brd_value *args,
+        size_t num_args,
+        struct brd_value *out,
+        int keep,
+        int union_b,
+        const char *name)
+{
+        struct brd_value_set *a, *b, *result;
+
+        if (num_args != 2) {
+                BARFA("%s accepts exactly 2 arguments", name);
+        }
+        a = brd_value_set_arg(&args[0], name);
+        b = brd_value_set_arg(&args[1], name);
+
+        result = brd_value_new_set(out);
+        for (size_t i = 0; i < a->dict.length; i++) {
+                struct brd_value *item = &a->dict.entries[i].key;
+
+                if (IS_VAL(a->dict.entries[i].value, BRD_VAL_UNIT)) {
+                        continue;
+                } else if (union_b || brd_value_set_has(b, item) == keep) {
+                        brd_value_set_add(result, item);
+                }
+        }
+        for (size_t i = 0; union_b && i < b->dict.length; i++) {
+                if (!IS_VAL(b->dict.entries[i].value, BRD_VAL_UNIT)) {
+                        brd_value_set_add(result, &b->dict.entries[i].key);
+                }
+        }
+        return true;
+}
+
+static int
+_builtin_union(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        return brd_value_set_combine(args, num_args, out, true, true, "@union");
+}
+
+static int
+_builtin_intersection(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        return brd_value_set_combine(args, num_args, out, true, false, "@intersection");
+}
+
+static int
+_builtin_difference(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        return brd_value_set_combine(args, num_args, out, false, false, "@difference");
+}
+
+static int
+_builtin_range(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        long double bounds[3] = { 0, 0, 1 };
+
+        if (num_args < 1 || num_args > 3) {
+                BARF("@range accepts 1 to 3 arguments");
+        }
+
+        /* @range(stop), @range(start, stop) or @range(start, stop, step) */
+        for (size_t i = 0; i < num_args; i++) {
+                brd_value_coerce_num(&args[i]);
+                bounds[num_args == 1 ? 1 : i] = args[i].as.num;
+        }
+        if (bounds[2] == 0) {
+                BARF("the step given to @range cannot be 0");
+        } else if (!isfinite(bounds[0]) || !isfinite(bounds[1])) {
+                BARF("the bounds given to @range must be finite");
+        }
+
+        out->vtype = BRD_VAL_HEAP;
+        out->as.heap = brd_heap_new(BRD_HEAP_RANGE);
+        brd_value_range_init(out->as.heap->as.range, bounds[0], bounds[1], bounds[2]);
+        return true;
+}
+
+static int
+_builtin_dict(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        (void)args;
+        if (num_args > 0) {
+                BARF("@dict takes no arguments");
+        }
+
+        out->vtype = BRD_VAL_HEAP;
+        out->as.heap = brd_heap_new(BRD_HEAP_DICT);
+        brd_value_dict_init(out->as.heap->as.dict);
+        return true;
+}
+
+static int
+_builtin_subclass(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_class *a, *b;
+        if (num_args != 2) {
+                BARF("@issubclassof takes exactly two arguments");
+        }
+
+        if (!IS_HEAP(args[0], BRD_HEAP_CLASS) || !IS_HEAP(args[1], BRD_HEAP_CLASS)) {
+                BARF("both arguments to @issubclassof must be classes");
+        }
+
+        a = args[0].as.heap->as.class;
+        b = args[1].as.heap->as.class;
+
+        out->vtype = BRD_VAL_BOOL;
+        out->as.boolean = false;
+        do {
+                if (a == b || (a = *a->super) == b) {
+                        out->as.boolean = true;
+                        break;
+                }
+        } while (a != object_class.as.heap->as.class);
+
+        return false;
+}
+
+static int
+_builtin_slice(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        intmax_t bounds[2] = { 0, INTMAX_MAX };
+        long double length = 0;
+
+        if (num_args != 2 && num_args != 3) {
+                BARF("@slice accepts 2 or 3 arguments");
+        }
+
+        if (IS_STRING(args[0])) {
+                length = STRING_LENGTH(args[0]);
+        } else if (IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                length = args[0].as.heap->as.list->length;
+        }
+
+        /* clamp before converting, anything past either end is the same */
+        for (size_t i = 1; i < num_args; i++) {
+                long double bound;
+
+                brd_value_coerce_num(&args[i]);
+                bound = floorl(args[i].as.num);
+                if (isnan(bound)) {
+                        BARF("bounds given to @slice must be numbers");
+                } else if (bound > length) {
+                        bound = length;
+                } else if (bound < -length) {
+                        bound = -length;
+                }
+                bounds[i - 1] = bound;
+        }
+
+        *out = args[0];
+        return brd_value_slice(out, bounds[0], bounds[1]);
+}
+
+static int
+brd_value_new_array(
+        enum brd_array_kind kind,
+        const char *name,
+        struct brd_value *args,
+        size_t num_args,
+        struct brd_value *out)
+{
+        struct brd_value_array *array;
 
-                new = brd_heap_new(BRD_HEAP_LIST);
-                if (IS_HEAP(*b, BRD_HEAP_LIST)) {
-                        struct brd_value_list *list_b = b->as.heap->as.list;
+        if (num_args != 1) {
+                BARFA("%s accepts exactly 1 argument", name);
+        }
 
-                        brd_value_list_init_with_capacity(
-                                new->as.list, list_a->length + list_b->length
-                        );
-                        new->as.list->length = list_a->length + list_b->length;
+        out->vtype = BRD_VAL_HEAP;
+        out->as.heap = brd_heap_new(BRD_HEAP_ARRAY);
+        array = out->as.heap->as.array;
 
-                        for (size_t i = 0; i < list_a->length; i++) {
-                                new->as.list->items[i] = list_a->items[i];
-                        }
-                        for (size_t i = 0; i < list_b->length; i++) {
-                                new->as.list->items[i + list_a->length]
-                                        = list_b->items[i];
-                        }
-                } else {
-                        brd_value_list_init_with_capacity(
-                                new->as.list, list_a->length + 1
-                        );
-                        new->as.list->length = list_a->length + 1;
-                        
-                        for (size_t i = 0; i < list_a->length; i++) {
-                                new->as.list->items[i] = list_a->items[i];
-                        }
-                        new->as.list->items[list_a->length] = *b;
+        /* either a length, or a list or array to copy */
+        if (IS_HEAP(args[0], BRD_HEAP_LIST)) {
+                struct brd_value_list *list = args[0].as.heap->as.list;
+
+                brd_value_array_init(array, kind, list->length);
+                for (size_t i = 0; i < list->length; i++) {
+                        struct brd_value item = brd_value_list_get(list, i);
+                        brd_value_array_set(array, i, &item);
                 }
-        } else {
-                int free_a, free_b;
-                char *new_string;
+        } else if (IS_HEAP(args[0], BRD_HEAP_ARRAY)) {
+                struct brd_value_array *from = args[0].as.heap->as.array;
 
-                free_a = brd_value_coerce_string(a);
-                free_b = brd_value_coerce_string(b);
-                new = brd_heap_new(BRD_HEAP_STRING);
-                
-                new_string = malloc(AS_STRING(*a)->length + AS_STRING(*b)->length + 1);
-                strcpy(new_string, AS_STRING(*a)->s);
-                strcpy(new_string + AS_STRING(*a)->length, AS_STRING(*b)->s);
-                brd_value_string_init(new->as.string, new_string);
+                brd_value_array_init(array, kind, from->length);
+                for (size_t i = 0; i < from->length; i++) {
+                        struct brd_value value;
 
-                if (free_a) {
-                        brd_heap_destroy(a->as.heap);
+                        brd_value_array_get(from, i, &value);
+                        brd_value_array_set(array, i, &value);
                 }
-                if (free_b) {
-                        brd_heap_destroy(b->as.heap);
+        } else {
+                long double length;
+
+                brd_value_coerce_num(&args[0]);
+                length = floorl(args[0].as.num);
+                if (isnan(length)) {
+                        BARFA("length given to %s must be a number", name);
+                } else if (length < 0) {
+                        BARFA("length given to %s cannot be negative", name);
+                } else if (length > SIZE_MAX / sizeof(double)) {
+                        BARFA("length given to %s is too large", name);
                 }
+                brd_value_array_init(array, kind, length);
         }
 
-        a->vtype = BRD_VAL_HEAP;
-        a->as.heap = new;
+        return true;
 }
 
 static int
-_builtin_write(struct brd_value *args, size_t num_args, struct brd_value *out)
+_builtin_f64array(struct brd_value *args, size_t num_args, struct brd_value *out)
 {
-        if (out != NULL) {
-                out->vtype = BRD_VAL_UNIT;
-        }
+        return brd_value_new_array(BRD_ARRAY_F64, "@f64array", args, num_args, out);
+}
 
-        for (size_t i = 0; i < num_args; i++) {
-                int new = brd_value_coerce_string(&args[i]);
-                printf("%s", AS_STRING(args[i])->s);
-                if (new) {
-                        brd_heap_destroy(args[i].as.heap);
-                }
+static int
+_builtin_i64array(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        return brd_value_new_array(BRD_ARRAY_I64, "@i64array", args, num_args, out);
+}
+
+static struct brd_value_array *
+brd_value_array_arg(struct brd_value *arg, const char *name)
+{
+        if (!IS_HEAP(*arg, BRD_HEAP_ARRAY)) {
+                BARFA("%s expects typed arrays, see @f64array and @i64array", name);
         }
+        return arg->as.heap->as.array;
+}
 
-        return false;
+/* kernels which take two arrays need them to be alike */
+static void
+brd_value_array_check_pair(
+        struct brd_value_array *a,
+        struct brd_value_array *b,
+        const char *name)
+{
+        if (a->kind != b->kind) {
+                BARFA("arrays given to %s must be of the same kind", name);
+        } else if (a->length != b->length) {
+                BARFA("arrays given to %s must have the same length", name);
+        }
 }
 
 static int
-_builtin_writeln(struct brd_value *args, size_t num_args, struct brd_value *out)
+_builtin_sum(struct brd_value *args, size_t num_args, struct brd_value *out)
 {
-        _builtin_write(args, num_args, out);
-        printf("\n");
+        struct brd_value_array *array;
+
+        if (num_args != 1) {
+                BARF("@sum accepts exactly 1 argument");
+        }
+        array = brd_value_array_arg(&args[0], "@sum");
+
+        out->vtype = BRD_VAL_NUM;
+        if (array->kind == BRD_ARRAY_F64) {
+                out->as.num = brd_array_f64_sum(array->as.f64, array->length);
+        } else {
+                out->as.num = brd_array_i64_sum(array->as.i64, array->length);
+        }
         return false;
 }
 
 static int
-_builtin_readln(struct brd_value *args, size_t num_args, struct brd_value *out)
+_builtin_dot(struct brd_value *args, size_t num_args, struct brd_value *out)
 {
-        ssize_t n;
-        size_t i;
-        char *str;
+        struct brd_value_array *a, *b;
 
-        (void)args;
-        if (num_args > 0) {
-                BARF("readln accepts no arguments");
+        if (num_args != 2) {
+                BARF("@dot accepts exactly 2 arguments");
         }
+        a = brd_value_array_arg(&args[0], "@dot");
+        b = brd_value_array_arg(&args[1], "@dot");
+        brd_value_array_check_pair(a, b, "@dot");
 
-
-        str = NULL;
-        if ((n = getline(&str, &i, stdin)) == -1) {
-                free(str);
-                out->vtype = BRD_VAL_UNIT;
-                return false;
+        out->vtype = BRD_VAL_NUM;
+        if (a->kind == BRD_ARRAY_F64) {
+                out->as.num = brd_array_f64_dot(a->as.f64, b->as.f64, a->length);
         } else {
-                out->vtype = BRD_VAL_HEAP;
-                out->as.heap = brd_heap_new(BRD_HEAP_STRING);
-                str[n-1] = '\0'; /* remove newline */
-                brd_value_string_init(out->as.heap->as.string, str);
-                return true;
+                out->as.num = brd_array_i64_dot(a->as.i64, b->as.i64, a->length);
         }
+        return false;
 }
 
 static int
-_builtin_length(struct brd_value *args, size_t num_args, struct brd_value *out)
+_builtin_scale(struct brd_value *args, size_t num_args, struct brd_value *out)
 {
-        if (num_args != 1) {
-                BARF("length accepts exactly 1 argument");
-        }
+        struct brd_value_array *array;
 
-        out->vtype = BRD_VAL_NUM;
+        if (num_args != 2) {
+                BARF("@scale accepts exactly 2 arguments");
+        }
+        array = brd_value_array_arg(&args[0], "@scale");
+        brd_value_coerce_num(&args[1]);
 
-        if (IS_STRING(args[0])) {
-                out->as.num = AS_STRING(args[0])->length;
-        } else if (IS_HEAP(args[0], BRD_HEAP_LIST)) {
-                out->as.num = args[0].as.heap->as.list->length;
-        } else if (IS_HEAP(args[0], BRD_HEAP_DICT)) {
-                out->as.num = args[0].as.heap->as.dict->size;
+        if (array->kind == BRD_ARRAY_F64) {
+                brd_array_f64_scale(array->as.f64, args[1].as.num, array->length);
+        } else {
+                brd_array_i64_scale(
+                        array->as.i64,
+                        brd_value_to_i64(args[1].as.num),
+                        array->length
+                );
         }
 
+        out->vtype = BRD_VAL_UNIT;
         return false;
 }
 
 static int
-_builtin_typeof(struct brd_value *args, size_t num_args, struct brd_value *out)
+_builtin_axpy(struct brd_value *args, size_t num_args, struct brd_value *out)
 {
+        struct brd_value_array *x, *y;
 
-        if (num_args != 1) {
-                BARF("typeof accepts exactly 1 argument");
+        if (num_args != 3) {
+                BARF("@axpy accepts exactly 3 arguments");
         }
+        brd_value_coerce_num(&args[0]);
+        x = brd_value_array_arg(&args[1], "@axpy");
+        y = brd_value_array_arg(&args[2], "@axpy");
+        brd_value_array_check_pair(x, y, "@axpy");
 
-        out->vtype = BRD_VAL_STRING;
-        switch (args[0].vtype) {
-        case BRD_VAL_NUM:
-                out->as.string = &number_string;
-                break;
-        case BRD_VAL_STRING:
-                out->as.string = &string_string;
-                break;
-        case BRD_VAL_BOOL:
-                out->as.string = &boolean_string;
-                break;
-        case BRD_VAL_UNIT:
-                out->as.string = &unit_string;
-                break;
-        case BRD_VAL_BUILTIN:
-                out->as.string = &builtin_string[args[0].as.builtin];
-                break;
-        case BRD_VAL_METHOD:
-                out->as.string = &method_string;
-                break;
-        case BRD_VAL_HEAP:
-                switch (args[0].as.heap->htype) {
-                case BRD_HEAP_STRING:
-                        out->as.string = &string_string;
-                        break;
-                case BRD_HEAP_LIST:
-                        out->as.string = &list_string;
-                        break;
-                case BRD_HEAP_CLOSURE:
-                        out->as.string = &closure_string;
-                        break;
-                case BRD_HEAP_CLASS:
-                        out->as.string = &class_string;
-                        break;
-                case BRD_HEAP_OBJECT:
-                        out->as.string = &object_string;
-                        break;
-                case BRD_HEAP_DICT:
-                        out->as.string = &dict_string;
-                        break;
-                }
+        if (x->kind == BRD_ARRAY_F64) {
+                brd_array_f64_axpy(args[0].as.num, x->as.f64, y->as.f64, x->length);
+        } else {
+                brd_array_i64_axpy(
+                        brd_value_to_i64(args[0].as.num),
+                        x->as.i64, y->as.i64, x->length
+                );
         }
 
+        out->vtype = BRD_VAL_UNIT;
         return false;
 }
 
 static int
-_builtin_system(struct brd_value *args, size_t num_args, struct brd_value *out)
+_builtin_min(struct brd_value *args, size_t num_args, struct brd_value *out)
 {
-        size_t len;
-        char *cmd;
-        int *malloced = malloc(sizeof(int) * num_args);
+        struct brd_value_array *array;
 
-        for(size_t i = 0; i < num_args; i++) {
-                malloced[i] = brd_value_coerce_string(&args[i]);
+        if (num_args != 1) {
+                BARF("@min accepts exactly 1 argument");
         }
+        array = brd_value_array_arg(&args[0], "@min");
 
-        len = 1;
-        for (size_t i = 0; i < num_args; i++) {
-                len += AS_STRING(args[i])->length;
-        }
-        cmd = malloc(sizeof(char) * len);
-        cmd[0] = '\0';
-        for (size_t i = 0; i < num_args; i++) {
-                strcat(cmd, AS_STRING(args[i])->s);
+        if (array->length == 0) {
+                out->vtype = BRD_VAL_UNIT;
+                return false;
         }
 
         out->vtype = BRD_VAL_NUM;
-        out->as.num = system(cmd);
-
-        for (size_t i = 0; i < num_args; i++) {
-                if (malloced[i]) {
-                        brd_heap_destroy(args[i].as.heap);
-                }
+        if (array->kind == BRD_ARRAY_F64) {
+                out->as.num = brd_array_f64_min(array->as.f64, array->length);
+        } else {
+                out->as.num = brd_array_i64_min(array->as.i64, array->length);
         }
-        free(malloced);
-        free(cmd);
         return false;
 }
 
 static int
-_builtin_string(struct brd_value *args, size_t num_args, struct brd_value *out)
+_builtin_max(struct brd_value *args, size_t num_args, struct brd_value *out)
 {
+        struct brd_value_array *array;
+
         if (num_args != 1) {
-                BARF("@string accepts exactly one argument");
+                BARF("@max accepts exactly 1 argument");
         }
+        array = brd_value_array_arg(&args[0], "@max");
 
-        *out = args[0];
-        return brd_value_coerce_string(out);
+        if (array->length == 0) {
+                out->vtype = BRD_VAL_UNIT;
+                return false;
+        }
+
+        out->vtype = BRD_VAL_NUM;
+        if (array->kind == BRD_ARRAY_F64) {
+                out->as.num = brd_array_f64_max(array->as.f64, array->length);
+        } else {
+                out->as.num = brd_array_i64_max(array->as.i64, array->length);
+        }
+        return false;
 }
 
-static int
-_builtin_push(struct brd_value *args, size_t num_args, struct brd_value *out)
+/* elementwise operations return a new array */
+static struct brd_value_array *
+brd_value_array_elementwise(
+        const char *name,
+        struct brd_value *args,
+        size_t num_args,
+        struct brd_value *out,
+        struct brd_value_array **a,
+        struct brd_value_array **b)
 {
-        struct brd_value_list *list;
-        if (num_args == 0) {
-                BARF("@push should be given at least one argument");
-        } else if (!IS_HEAP(args[0], BRD_HEAP_LIST)) {
-                BARF("first argument to @push should be a list");
-        }
+        struct brd_value_array *array;
 
-        list = args[0].as.heap->as.list;
-        for (size_t i = 1; i < num_args; i++) {
-                brd_value_list_push(list, &args[i]);
+        if (num_args != 2) {
+                BARFA("%s accepts exactly 2 arguments", name);
         }
+        *a = brd_value_array_arg(&args[0], name);
+        *b = brd_value_array_arg(&args[1], name);
+        brd_value_array_check_pair(*a, *b, name);
 
-        out->vtype = BRD_VAL_UNIT;
-        return false;
+        out->vtype = BRD_VAL_HEAP;
+        out->as.heap = brd_heap_new(BRD_HEAP_ARRAY);
+        array = out->as.heap->as.array;
+        brd_value_array_init(array, (*a)->kind, (*a)->length);
+        return array;
 }
 
 static int
-_builtin_insert(struct brd_value *args, size_t num_args, struct brd_value *out)
+_builtin_add(struct brd_value *args, size_t num_args, struct brd_value *out)
 {
-        struct brd_value_list *list;
-        size_t idx;
-        long double num;
+        struct brd_value_array *a, *b, *sum;
 
-        if (num_args != 3) {
-                BARF("@insert accepts exactly 3 arguments");
-        } else if (!IS_HEAP(args[0], BRD_HEAP_LIST)) {
-                BARF("first argument to @insert should be a list");
+        /* @add also adds an item to a set */
+        if (num_args == 2 && IS_HEAP(args[0], BRD_HEAP_SET)) {
+                brd_value_set_add(args[0].as.heap->as.set, &args[1]);
+                out->vtype = BRD_VAL_UNIT;
+                return false;
         }
 
-        list = args[0].as.heap->as.list;
-
-        brd_value_coerce_num(&args[2]);
-        num = floorl(args[2].as.num);
-        if (num < 0) {
-                BARF("index for @insert cannot be negative");
+        sum = brd_value_array_elementwise("@add", args, num_args, out, &a, &b);
+        if (a->kind == BRD_ARRAY_F64) {
+                brd_array_f64_add(sum->as.f64, a->as.f64, b->as.f64, a->length);
+        } else {
+                brd_array_i64_add(sum->as.i64, a->as.i64, b->as.i64, a->length);
         }
-        idx = num;
+        return true;
+}
 
-        if (list->length <= idx) {
-                struct brd_value unit;
-                unit.vtype = BRD_VAL_UNIT;
+static int
+_builtin_mul(struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        struct brd_value_array *a, *b, *product;
 
-                for (size_t i = list->length; i < idx; i++) {
-                        brd_value_list_push(list, &unit);
-                }
-                brd_value_list_push(list, &args[1]);
+        product = brd_value_array_elementwise("@mul", args, num_args, out, &a, &b);
+        if (a->kind == BRD_ARRAY_F64) {
+                brd_array_f64_mul(product->as.f64, a->as.f64, b->as.f64, a->length);
         } else {
-                struct brd_value_list new;
-                brd_value_list_init_with_capacity(&new, list->length + 1);
+                brd_array_i64_mul(product->as.i64, a->as.i64, b->as.i64, a->length);
+        }
+        return true;
+}
 
-                for (size_t i = 0; i < idx; i++) {
-                        new.items[i] = list->items[i];
-                }
-                new.items[idx] = args[1];
-                for (size_t i = idx + 1; i < list->length + 1; i++) {
-                        new.items[i] = list->items[i - 1];
-                }
+#define MK_BUILTIN_STRING(str) { .s = str, .length = sizeof(str) - 1 }
 
-                new.length = list->length + 1;
-                free(list->items);
-                *list = new;
-        }
+static struct brd_value_string gcstats_keys[] = {
+        MK_BUILTIN_STRING("collections"),
+        MK_BUILTIN_STRING("total_pause"),
+        MK_BUILTIN_STRING("max_pause"),
+        MK_BUILTIN_STRING("bytes_allocated"),
+        MK_BUILTIN_STRING("threshold"),
+        MK_BUILTIN_STRING("live"),
+};
 
-        out->vtype = BRD_VAL_UNIT;
-        return false;
+static void
+gcstats_set(struct brd_value_dict *dict, struct brd_value_string *key, struct brd_value *value)
+{
+        struct brd_value k;
+
+        k.vtype = BRD_VAL_STRING;
+        k.as.string = key;
+        brd_value_dict_set(dict, &k, value);
 }
 
 static int
-_builtin_dict(struct brd_value *args, size_t num_args, struct brd_value *out)
+_builtin_gcstats(struct brd_value *args, size_t num_args, struct brd_value *out)
 {
+        struct brd_value_dict *dict;
+        struct brd_value value, live;
+        long double stats[] = {
+                gc_stats.collections,
+                gc_stats.total_pause,
+                gc_stats.max_pause,
+                gc_stats.bytes_allocated,
+                vm.threshold,
+        };
+
         (void)args;
         if (num_args > 0) {
-                BARF("@dict takes no arguments");
+                BARF("@gcstats takes no arguments");
         }
 
         out->vtype = BRD_VAL_HEAP;
         out->as.heap = brd_heap_new(BRD_HEAP_DICT);
-        brd_value_dict_init(out->as.heap->as.dict);
-        return true;
-}
+        dict = out->as.heap->as.dict;
+        brd_value_dict_init(dict);
 
-static int
-_builtin_subclass(struct brd_value *args, size_t num_args, struct brd_value *out)
-{
-        struct brd_value_class *a, *b;
-        if (num_args != 2) {
-                BARF("@issubclassof takes exactly two arguments");
+        value.vtype = BRD_VAL_NUM;
+        for (size_t i = 0; i < sizeof(stats) / sizeof(stats[0]); i++) {
+                value.as.num = stats[i];
+                gcstats_set(dict, &gcstats_keys[i], &value);
         }
 
-        if (!IS_HEAP(args[0], BRD_HEAP_CLASS) || !IS_HEAP(args[1], BRD_HEAP_CLASS)) {
-                BARF("both arguments to @issubclassof must be classes");
+        /* live entries by type, this dict is reachable from the outer one */
+        live.vtype = BRD_VAL_HEAP;
+        live.as.heap = brd_heap_new(BRD_HEAP_DICT);
+        brd_value_dict_init(live.as.heap->as.dict);
+        brd_vm_allocate(live.as.heap);
+        for (int i = 0; i < BRD_NUM_HEAP_TYPES; i++) {
+                value.as.num = gc_stats.live[i];
+                gcstats_set(live.as.heap->as.dict, brd_heap_type_string(i), &value);
         }
+        gcstats_set(dict, &gcstats_keys[5], &live);
 
-        a = args[0].as.heap->as.class;
-        b = args[1].as.heap->as.class;
-
-        out->vtype = BRD_VAL_BOOL;
-        out->as.boolean = false;
-        do {
-                if (a == b || (a = *a->super) == b) {
-                        out->as.boolean = true;
-                        break;
-                }
-        } while (a != object_class.as.heap->as.class);
-
-        return false;
+        return true;
 }
 
 enum brd_builtin brd_lookup_builtin(char *builtin)
@@ -1279,6 +3686,40 @@ const builtin_fn_dec builtin_function[BRD_NUM_BUILTIN] = {
         [BRD_BUILTIN_INSERT] = _builtin_insert,
         [BRD_BUILTIN_DICT] = _builtin_dict,
         [BRD_BUILTIN_SUBCLASS] = _builtin_subclass,
+        [BRD_BUILTIN_GCSTATS] = _builtin_gcstats,
+        [BRD_BUILTIN_SLICE] = _builtin_slice,
+        [BRD_BUILTIN_PUSHFRONT] = _builtin_pushfront,
+        [BRD_BUILTIN_POP] = _builtin_pop,
+        [BRD_BUILTIN_POPFRONT] = _builtin_popfront,
+        [BRD_BUILTIN_REMOVE] = _builtin_remove,
+        [BRD_BUILTIN_F64ARRAY] = _builtin_f64array,
+        [BRD_BUILTIN_I64ARRAY] = _builtin_i64array,
+        [BRD_BUILTIN_SUM] = _builtin_sum,
+        [BRD_BUILTIN_DOT] = _builtin_dot,
+        [BRD_BUILTIN_SCALE] = _builtin_scale,
+        [BRD_BUILTIN_AXPY] = _builtin_axpy,
+        [BRD_BUILTIN_MIN] = _builtin_min,
+        [BRD_BUILTIN_MAX] = _builtin_max,
+        [BRD_BUILTIN_ADD] = _builtin_add,
+        [BRD_BUILTIN_MUL] = _builtin_mul,
+        [BRD_BUILTIN_SORT] = _builtin_sort,
+        [BRD_BUILTIN_MAP] = _builtin_map,
+        [BRD_BUILTIN_FILTER] = _builtin_filter,
+        [BRD_BUILTIN_REDUCE] = _builtin_reduce,
+        [BRD_BUILTIN_ANY] = _builtin_any,
+        [BRD_BUILTIN_ALL] = _builtin_all,
+        [BRD_BUILTIN_FOREACH] = _builtin_foreach,
+        [BRD_BUILTIN_HEAP] = _builtin_heap,
+        [BRD_BUILTIN_HEAPPUSH] = _builtin_heappush,
+        [BRD_BUILTIN_HEAPPOP] = _builtin_heappop,
+        [BRD_BUILTIN_HEAPPEEK] = _builtin_heappeek,
+        [BRD_BUILTIN_SET] = _builtin_set,
+        [BRD_BUILTIN_HAS] = _builtin_has,
+        [BRD_BUILTIN_DISCARD] = _builtin_discard,
+        [BRD_BUILTIN_UNION] = _builtin_union,
+        [BRD_BUILTIN_INTERSECTION] = _builtin_intersection,
+        [BRD_BUILTIN_DIFFERENCE] = _builtin_difference,
+        [BRD_BUILTIN_RANGE] = _builtin_range,
 };
 
 const char *builtin_name[BRD_NUM_BUILTIN] = {
@@ -1293,10 +3734,42 @@ const char *builtin_name[BRD_NUM_BUILTIN] = {
         [BRD_BUILTIN_INSERT] = "insert",
         [BRD_BUILTIN_DICT] = "dict",
         [BRD_BUILTIN_SUBCLASS] = "issubclassof",
+        [BRD_BUILTIN_GCSTATS] = "gcstats",
+        [BRD_BUILTIN_SLICE] = "slice",
+        [BRD_BUILTIN_PUSHFRONT] = "pushfront",
+        [BRD_BUILTIN_POP] = "pop",
+        [BRD_BUILTIN_POPFRONT] = "popfront",
+        [BRD_BUILTIN_REMOVE] = "remove",
+        [BRD_BUILTIN_F64ARRAY] = "f64array",
+        [BRD_BUILTIN_I64ARRAY] = "i64array",
+        [BRD_BUILTIN_SUM] = "sum",
+        [BRD_BUILTIN_DOT] = "dot",
+        [BRD_BUILTIN_SCALE] = "scale",
+        [BRD_BUILTIN_AXPY] = "axpy",
+        [BRD_BUILTIN_MIN] = "min",
+        [BRD_BUILTIN_MAX] = "max",
+        [BRD_BUILTIN_ADD] = "add",
+        [BRD_BUILTIN_MUL] = "mul",
+        [BRD_BUILTIN_SORT] = "sort",
+        [BRD_BUILTIN_MAP] = "map",
+        [BRD_BUILTIN_FILTER] = "filter",
+        [BRD_BUILTIN_REDUCE] = "reduce",
+        [BRD_BUILTIN_ANY] = "any",
+        [BRD_BUILTIN_ALL] = "all",
+        [BRD_BUILTIN_FOREACH] = "foreach",
+        [BRD_BUILTIN_HEAP] = "heap",
+        [BRD_BUILTIN_HEAPPUSH] = "heappush",
+        [BRD_BUILTIN_HEAPPOP] = "heappop",
+        [BRD_BUILTIN_HEAPPEEK] = "heappeek",
+        [BRD_BUILTIN_SET] = "set",
+        [BRD_BUILTIN_HAS] = "has",
+        [BRD_BUILTIN_DISCARD] = "discard",
+        [BRD_BUILTIN_UNION] = "union",
+        [BRD_BUILTIN_INTERSECTION] = "intersection",
+        [BRD_BUILTIN_DIFFERENCE] = "difference",
+        [BRD_BUILTIN_RANGE] = "range",
 };
 
-#define MK_BUILTIN_STRING(str) { str, sizeof(str) - 1 }
-
 struct brd_value_string builtin_string[BRD_NUM_BUILTIN] = {
         [BRD_BUILTIN_WRITE]   = MK_BUILTIN_STRING("@write"),
         [BRD_BUILTIN_WRITELN] = MK_BUILTIN_STRING("@writeln"),
@@ -1309,6 +3782,40 @@ struct brd_value_string builtin_string[BRD_NUM_BUILTIN] = {
         [BRD_BUILTIN_INSERT] = MK_BUILTIN_STRING("@insert"),
         [BRD_BUILTIN_DICT] = MK_BUILTIN_STRING("@dict"),
         [BRD_BUILTIN_SUBCLASS] = MK_BUILTIN_STRING("@issubclassof"),
+        [BRD_BUILTIN_GCSTATS] = MK_BUILTIN_STRING("@gcstats"),
+        [BRD_BUILTIN_SLICE] = MK_BUILTIN_STRING("@slice"),
+        [BRD_BUILTIN_PUSHFRONT] = MK_BUILTIN_STRING("@pushfront"),
+        [BRD_BUILTIN_POP] = MK_BUILTIN_STRING("@pop"),
+        [BRD_BUILTIN_POPFRONT] = MK_BUILTIN_STRING("@popfront"),
+        [BRD_BUILTIN_REMOVE] = MK_BUILTIN_STRING("@remove"),
+        [BRD_BUILTIN_F64ARRAY] = MK_BUILTIN_STRING("@f64array"),
+        [BRD_BUILTIN_I64ARRAY] = MK_BUILTIN_STRING("@i64array"),
+        [BRD_BUILTIN_SUM] = MK_BUILTIN_STRING("@sum"),
+        [BRD_BUILTIN_DOT] = MK_BUILTIN_STRING("@dot"),
+        [BRD_BUILTIN_SCALE] = MK_BUILTIN_STRING("@scale"),
+        [BRD_BUILTIN_AXPY] = MK_BUILTIN_STRING("@axpy"),
+        [BRD_BUILTIN_MIN] = MK_BUILTIN_STRING("@min"),
+        [BRD_BUILTIN_MAX] = MK_BUILTIN_STRING("@max"),
+        [BRD_BUILTIN_ADD] = MK_BUILTIN_STRING("@add"),
+        [BRD_BUILTIN_MUL] = MK_BUILTIN_STRING("@mul"),
+        [BRD_BUILTIN_SORT] = MK_BUILTIN_STRING("@sort"),
+        [BRD_BUILTIN_MAP] = MK_BUILTIN_STRING("@map"),
+        [BRD_BUILTIN_FILTER] = MK_BUILTIN_STRING("@filter"),
+        [BRD_BUILTIN_REDUCE] = MK_BUILTIN_STRING("@reduce"),
+        [BRD_BUILTIN_ANY] = MK_BUILTIN_STRING("@any"),
+        [BRD_BUILTIN_ALL] = MK_BUILTIN_STRING("@all"),
+        [BRD_BUILTIN_FOREACH] = MK_BUILTIN_STRING("@foreach"),
+        [BRD_BUILTIN_HEAP] = MK_BUILTIN_STRING("@heap"),
+        [BRD_BUILTIN_HEAPPUSH] = MK_BUILTIN_STRING("@heappush"),
+        [BRD_BUILTIN_HEAPPOP] = MK_BUILTIN_STRING("@heappop"),
+        [BRD_BUILTIN_HEAPPEEK] = MK_BUILTIN_STRING("@heappeek"),
+        [BRD_BUILTIN_SET] = MK_BUILTIN_STRING("@set"),
+        [BRD_BUILTIN_HAS] = MK_BUILTIN_STRING("@has"),
+        [BRD_BUILTIN_DISCARD] = MK_BUILTIN_STRING("@discard"),
+        [BRD_BUILTIN_UNION] = MK_BUILTIN_STRING("@union"),
+        [BRD_BUILTIN_INTERSECTION] = MK_BUILTIN_STRING("@intersection"),
+        [BRD_BUILTIN_DIFFERENCE] = MK_BUILTIN_STRING("@difference"),
+        [BRD_BUILTIN_RANGE] = MK_BUILTIN_STRING("@range"),
 };
 
 struct brd_value_string number_string = MK_BUILTIN_STRING("number");
@@ -1321,6 +3828,10 @@ struct brd_value_string closure_string = MK_BUILTIN_STRING("closure");
 struct brd_value_string class_string = MK_BUILTIN_STRING("class");
 struct brd_value_string object_string = MK_BUILTIN_STRING("object");
 struct brd_value_string dict_string = MK_BUILTIN_STRING("dict");
+struct brd_value_string array_string = MK_BUILTIN_STRING("array");
+struct brd_value_string pqueue_string = MK_BUILTIN_STRING("heap");
+struct brd_value_string set_string = MK_BUILTIN_STRING("set");
+struct brd_value_string range_string = MK_BUILTIN_STRING("range");
 struct brd_value_string true_string = MK_BUILTIN_STRING("true");
 struct brd_value_string false_string = MK_BUILTIN_STRING("false");
 
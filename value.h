@@ -13,6 +13,18 @@
  */
 #define BUCKET_SIZE 24
 
+/* concatenations shorter than this are copied right away instead of roped */
+#define ROPE_THRESHOLD 64
+
+/* initial number of slots in a dict's index */
+#define DICT_SIZE 8
+
+/* strings up to this long are stored inside the brd_value itself */
+#define SMALL_STRING_MAX 15
+
+/* integers from 0 up to (but not including) this have a string constant */
+#define INT_STRINGS 1024
+
 // inspired by wl_container_of from wayland
 #define brd_containing_heap(type, item) ((struct brd_heap_entry *)\
         (((char *)(item)) - offsetof(struct brd_heap_entry, as.type)))
@@ -27,8 +39,17 @@
 
 #define IS_VAL(v, type) ((v).vtype == type)
 #define IS_HEAP(v, type) (IS_VAL(v, BRD_VAL_HEAP) && (v).as.heap->htype == type)
-#define IS_STRING(v) (IS_VAL((v), BRD_VAL_STRING) || IS_HEAP((v), BRD_HEAP_STRING))
-#define AS_STRING(v) (IS_VAL((v), BRD_VAL_STRING) ? (v).as.string : (v).as.heap->as.string)
+#define IS_STRING(v) (IS_VAL((v), BRD_VAL_STRING)\
+        || IS_VAL((v), BRD_VAL_SMALL_STRING)\
+        || IS_HEAP((v), BRD_HEAP_STRING))
+/* may be an unflattened rope, only the length is safe to use */
+#define AS_ROPE_STRING(v) (IS_VAL((v), BRD_VAL_STRING) ? (v).as.string : (v).as.heap->as.string)
+#define AS_STRING(v) brd_value_string_flatten(AS_ROPE_STRING(v))
+
+/* these also work on small strings, which have no brd_value_string */
+#define STRING_CHARS(v) (IS_VAL((v), BRD_VAL_SMALL_STRING) ? (v).as.small : AS_STRING(v)->s)
+#define STRING_LENGTH(v) (IS_VAL((v), BRD_VAL_SMALL_STRING) ?\
+        (size_t)(v).small_length : AS_ROPE_STRING(v)->length)
 
 struct brd_value;
 struct brd_value_closure;
@@ -38,6 +59,11 @@ struct brd_value_string;
 struct brd_value_class;
 struct brd_value_object;
 struct brd_value_dict;
+struct brd_value_array;
+struct brd_value_pqueue;
+struct brd_value_set;
+struct brd_value_range;
+struct brd_gc_stack;
 
 enum brd_heap_type {
         BRD_HEAP_STRING,
@@ -46,26 +72,88 @@ enum brd_heap_type {
         BRD_HEAP_CLASS,
         BRD_HEAP_OBJECT,
         BRD_HEAP_DICT,
+        BRD_HEAP_ARRAY,
+        BRD_HEAP_PQUEUE,
+        BRD_HEAP_SET,
+        BRD_HEAP_RANGE,
+};
+
+#define BRD_NUM_HEAP_TYPES (BRD_HEAP_RANGE + 1)
+
+/*
+ * Slices share their parent's buffer instead of copying it, so a list's items
+ * point somewhere into a buffer which may be referenced by other lists.
+ * A list copies its items into a buffer of its own before writing to a
+ * shared one. Popping from the front just moves items forward, and the room
+ * left before them is reused when pushing onto the front.
+ *
+ * Lists which have only ever held numbers store them unboxed, and switch
+ * to storing whole values the first time anything else is stored in them.
+ */
+struct brd_value_list_buffer {
+        size_t refs; /* lists using this buffer, changed atomically */
+        size_t size; /* in bytes */
+        unsigned char data[];
+};
+
+enum brd_list_kind {
+        BRD_LIST_NUMS,
+        BRD_LIST_VALUES,
 };
 
 struct brd_value_list {
-        size_t length, capacity;
-        struct brd_value *items;
+        size_t length;
+        union {
+                long double *nums;
+                struct brd_value *values;
+        } as;
+        struct brd_value_list_buffer *buffer;
+        enum brd_list_kind kind;
+        char _p[7];
 };
 
 void brd_value_list_init(struct brd_value_list *list);
+void brd_value_list_init_items(struct brd_value_list *list, struct brd_value *items, size_t num_items, size_t capacity);
+void brd_value_list_destroy(struct brd_value_list *list);
+struct brd_value brd_value_list_get(struct brd_value_list *list, size_t idx);
 void brd_value_list_push(struct brd_value_list *list, struct brd_value *value);
+void brd_value_list_push_front(struct brd_value_list *list, struct brd_value *value);
+void brd_value_list_insert(struct brd_value_list *list, size_t idx, struct brd_value *value);
+void brd_value_list_remove(struct brd_value_list *list, size_t idx, struct brd_value *out);
 void brd_value_list_set(struct brd_value_list *list, size_t idx, struct brd_value *value);
 char *brd_value_list_to_string(struct brd_value_list *list);
 int brd_value_list_equals(struct brd_value_list *a, struct brd_value_list *b);
 
+/*
+ * Concatenating long strings makes a rope which refers to both operands.
+ * s is NULL until something needs the characters, at which point
+ * the rope is flattened
+ */
+enum brd_string_num {
+        BRD_STRING_NUM_UNKNOWN, /* not parsed yet */
+        BRD_STRING_NUM_VALID,
+        BRD_STRING_NUM_INVALID, /* doesn't start with a number, num is 0 */
+};
+
 struct brd_value_string {
         char *s;
         size_t length;
+        struct brd_value_rope *rope;
+        unsigned long hash; /* 0 until it's needed */
+
+        /* what the string coerces to, parsed the first time it's needed */
+        enum brd_string_num num_state;
+        char _p[15];
+        long double num;
 };
 
 void brd_value_string_init(struct brd_value_string *string, char *s);
+void brd_value_init_string_constants(void);
+void brd_value_small_string(struct brd_value *value, const char *s, size_t length);
 struct brd_value_string *brd_value_string_new(char *s);
+struct brd_value_string *brd_value_string_flatten(struct brd_value_string *string);
+long double brd_value_string_num(struct brd_value_string *string);
+unsigned long brd_value_string_hash(struct brd_value_string *string);
 
 struct brd_heap_entry {
         struct brd_heap_entry *next;
@@ -77,6 +165,10 @@ struct brd_heap_entry {
                 struct brd_value_class *class;
                 struct brd_value_object *object;
                 struct brd_value_dict *dict;
+                struct brd_value_array *array;
+                struct brd_value_pqueue *pqueue;
+                struct brd_value_set *set;
+                struct brd_value_range *range;
         } as;
 
         int marked; /* for GC */
@@ -87,10 +179,14 @@ struct brd_heap_entry {
 
 struct brd_heap_entry *brd_heap_new(enum brd_heap_type htype);
 void brd_heap_destroy(struct brd_heap_entry *entry);
+void brd_heap_gc_trace(struct brd_heap_entry *entry, struct brd_gc_stack *gray);
+size_t brd_heap_size(struct brd_heap_entry *entry);
+struct brd_value_string *brd_heap_type_string(enum brd_heap_type htype);
 
 enum brd_value_type {
         BRD_VAL_NUM,
         BRD_VAL_STRING, /* string constant */
+        BRD_VAL_SMALL_STRING, /* short string stored inline */
         BRD_VAL_BOOL,
         BRD_VAL_UNIT,
         BRD_VAL_BUILTIN,
@@ -112,17 +208,27 @@ struct brd_value {
                 int builtin;
                 struct brd_value_method method;
                 struct brd_heap_entry *heap;
+                char small[SMALL_STRING_MAX + 1];
         } as;
         enum brd_value_type vtype;
-        char _p[15];
-        // not loving that we're wasting 15 bytes here
+        unsigned char small_length;
+        char _p[14];
 };
 
-void brd_value_gc_mark(struct brd_value *value);
+void brd_value_gc_mark(struct brd_value *value, struct brd_gc_stack *gray);
+
+/* a slice of a longer string is a rope with only a left side */
+struct brd_value_rope {
+        struct brd_value left, right; /* right is unit for slices */
+        size_t start; /* where a slice starts in left */
+        char _p[8];
+};
 
 struct brd_value_map_list {
         char *key;
         struct brd_value_map_list *next;
+        unsigned long hash;
+        char _p[8];
         struct brd_value val;
 };
 
@@ -134,8 +240,11 @@ void brd_value_map_init(struct brd_value_map *map);
 void brd_value_map_destroy(struct brd_value_map *map);
 void brd_value_map_set(struct brd_value_map *map, char *key, struct brd_value *val);
 struct brd_value *brd_value_map_get(struct brd_value_map *map, char *key);
+void brd_value_map_set_hashed(struct brd_value_map *map, char *key, unsigned long h, struct brd_value *val);
+struct brd_value *brd_value_map_get_hashed(struct brd_value_map *map, char *key, unsigned long h);
+void brd_value_map_remove_hashed(struct brd_value_map *map, char *key, unsigned long h);
 void brd_value_map_copy(struct brd_value_map *dest, struct brd_value_map *src);
-void brd_value_map_mark(struct brd_value_map *map);
+void brd_value_map_mark(struct brd_value_map *map, struct brd_gc_stack *gray);
 
 struct brd_value_closure {
         struct brd_value_map env;
@@ -168,18 +277,113 @@ void brd_value_object_init(struct brd_value_object *object, struct brd_value_cla
 void brd_value_object_destroy(struct brd_value_object *object);
 void brd_value_object_super(struct brd_value_object *this, struct brd_value_object *super);
 
+/*
+ * Dicts are keyed by any value: strings and numbers by what they hold,
+ * everything else on the heap by identity.
+ *
+ * Entries are kept densely in insertion order, and an open addressed index
+ * maps hashes to positions in the entry array. Setting a key to unit removes
+ * it, leaving a hole in the entries which is dropped the next time they're
+ * compacted.
+ */
+#define DICT_EMPTY (-1)
+#define DICT_DELETED (-2)
+
+struct brd_value_dict_entry {
+        struct brd_value key, value; /* value is unit for removed entries */
+        unsigned long hash;
+        char _p[8];
+};
+
 struct brd_value_dict {
-        struct brd_value_list keys;
-        struct brd_value_map map;
-        size_t size;
+        struct brd_value_dict_entry *entries;
+        long *index; /* position in entries, DICT_EMPTY or DICT_DELETED */
+        size_t capacity; /* number of slots in index, always a power of two */
+        size_t length; /* number of entries used, including removed ones */
+        size_t size; /* number of entries which haven't been removed */
+        size_t iterators; /* number of loops part way through the entries */
 };
 
 void brd_value_dict_init(struct brd_value_dict *dict);
+void brd_value_dict_init_with_size(struct brd_value_dict *dict, size_t size);
 void brd_value_dict_destroy(struct brd_value_dict *dict);
 struct brd_value *brd_value_dict_get(struct brd_value_dict *dict, struct brd_value *key);
 void brd_value_dict_set(struct brd_value_dict *dict, struct brd_value *key, struct brd_value *value);
+size_t brd_value_dict_usable(size_t capacity);
 char *brd_value_dict_to_string(struct brd_value_dict *dict);
 
+/* sets are dicts whose keys are the items, every value is true */
+struct brd_value_set {
+        struct brd_value_dict dict;
+};
+
+void brd_value_set_init(struct brd_value_set *set);
+void brd_value_set_destroy(struct brd_value_set *set);
+int brd_value_set_has(struct brd_value_set *set, struct brd_value *item);
+void brd_value_set_add(struct brd_value_set *set, struct brd_value *item);
+int brd_value_set_discard(struct brd_value_set *set, struct brd_value *item);
+char *brd_value_set_to_string(struct brd_value_set *set);
+
+/* typed arrays hold unboxed numbers of a single kind and have a fixed length */
+enum brd_array_kind {
+        BRD_ARRAY_F64,
+        BRD_ARRAY_I64,
+};
+
+struct brd_value_array {
+        union {
+                double *f64;
+                int64_t *i64;
+        } as;
+        size_t length;
+        enum brd_array_kind kind;
+        char _p[7];
+};
+
+void brd_value_array_init(struct brd_value_array *array, enum brd_array_kind kind, size_t length);
+void brd_value_array_destroy(struct brd_value_array *array);
+void brd_value_array_get(struct brd_value_array *array, size_t idx, struct brd_value *out);
+void brd_value_array_set(struct brd_value_array *array, intmax_t idx, struct brd_value *value);
+char *brd_value_array_to_string(struct brd_value_array *array);
+
+/*
+ * Priority queues are binary min-heaps ordered by brd_value_compare. Each
+ * item is stored with its key, which is the item itself unless the queue
+ * was given a key function, so that keys are computed once per push.
+ */
+struct brd_value_pqueue_entry {
+        struct brd_value key, value;
+};
+
+struct brd_value_pqueue {
+        struct brd_value key_fn; /* unit if items are their own keys */
+        struct brd_value_pqueue_entry *entries;
+        size_t length, capacity;
+        char _p[8];
+};
+
+void brd_value_pqueue_init(struct brd_value_pqueue *pqueue, struct brd_value *key_fn);
+void brd_value_pqueue_destroy(struct brd_value_pqueue *pqueue);
+void brd_value_pqueue_push(struct brd_value_pqueue *pqueue, struct brd_value *key, struct brd_value *value);
+void brd_value_pqueue_pop(struct brd_value_pqueue *pqueue, struct brd_value *out);
+
+/* ranges are lazy, items are computed from the start and the step */
+struct brd_value_range {
+        long double start, step;
+        size_t length;
+        char _p[8];
+};
+
+void brd_value_range_init(struct brd_value_range *range, long double start, long double stop, long double step);
+long double brd_value_range_get(struct brd_value_range *range, size_t idx);
+
+/*
+ * A for in loop keeps the value it iterates over and a position on the stack,
+ * brd_value_iter_next gives the item at the position and moves it along
+ */
+int brd_value_iterable(struct brd_value *value);
+int brd_value_iter_next(struct brd_value *value, size_t *pos, struct brd_value *out);
+
 struct brd_comparison {
         signed char cmp;
         char is_ord;
@@ -198,11 +402,14 @@ int brd_comparison_eq(struct brd_comparison cmp);
 void brd_value_debug(struct brd_value *value);
 int brd_value_is_string(struct brd_value *value);
 void brd_value_coerce_num(struct brd_value *value);
+size_t brd_value_format_num(long double num, char *buf);
 int brd_value_coerce_string(struct brd_value *value);
 int brd_value_index(struct brd_value *value, intmax_t idx);
+int brd_value_slice(struct brd_value *value, intmax_t start, intmax_t end);
 int brd_value_truthify(struct brd_value *value);
+int brd_value_equals(struct brd_value *a, struct brd_value *b);
 struct brd_comparison brd_value_compare(struct brd_value *a, struct brd_value *b);
-void brd_value_concat(struct brd_value *a, struct brd_value *b);
+int brd_value_concat(struct brd_value *a, struct brd_value *b);
 
 enum brd_builtin {
         BRD_BUILTIN_WRITE,
@@ -216,6 +423,40 @@ enum brd_builtin {
         BRD_BUILTIN_INSERT,
         BRD_BUILTIN_DICT,
         BRD_BUILTIN_SUBCLASS,
+        BRD_BUILTIN_GCSTATS,
+        BRD_BUILTIN_SLICE,
+        BRD_BUILTIN_PUSHFRONT,
+        BRD_BUILTIN_POP,
+        BRD_BUILTIN_POPFRONT,
+        BRD_BUILTIN_REMOVE,
+        BRD_BUILTIN_F64ARRAY,
+        BRD_BUILTIN_I64ARRAY,
+        BRD_BUILTIN_SUM,
+        BRD_BUILTIN_DOT,
+        BRD_BUILTIN_SCALE,
+        BRD_BUILTIN_AXPY,
+        BRD_BUILTIN_MIN,
+        BRD_BUILTIN_MAX,
+        BRD_BUILTIN_ADD,
+        BRD_BUILTIN_MUL,
+        BRD_BUILTIN_SORT,
+        BRD_BUILTIN_MAP,
+        BRD_BUILTIN_FILTER,
+        BRD_BUILTIN_REDUCE,
+        BRD_BUILTIN_ANY,
+        BRD_BUILTIN_ALL,
+        BRD_BUILTIN_FOREACH,
+        BRD_BUILTIN_HEAP,
+        BRD_BUILTIN_HEAPPUSH,
+        BRD_BUILTIN_HEAPPOP,
+        BRD_BUILTIN_HEAPPEEK,
+        BRD_BUILTIN_SET,
+        BRD_BUILTIN_HAS,
+        BRD_BUILTIN_DISCARD,
+        BRD_BUILTIN_UNION,
+        BRD_BUILTIN_INTERSECTION,
+        BRD_BUILTIN_DIFFERENCE,
+        BRD_BUILTIN_RANGE,
         BRD_NUM_BUILTIN,
         BRD_GLOBAL_OBJECT,
 };
@@ -243,6 +484,10 @@ extern struct brd_value_string closure_string;
 extern struct brd_value_string class_string;
 extern struct brd_value_string object_string;
 extern struct brd_value_string dict_string;
+extern struct brd_value_string array_string;
+extern struct brd_value_string pqueue_string;
+extern struct brd_value_string set_string;
+extern struct brd_value_string range_string;
 extern struct brd_value_string true_string;
 extern struct brd_value_string false_string;
 
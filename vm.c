@@ -2,9 +2,12 @@
 #include "ast.h"
 #include "value.h"
 #include "vm.h"
+#include "gc.h"
 
 #define LIST_SIZE 32
 #define GROW 1.5
+/* literals put at most this many items on the stack at once */
+#define LITERAL_CHUNK 16
 
 struct brd_vm vm;
 
@@ -49,6 +52,12 @@ brd_bytecode_debug(enum brd_bytecode op)
         case BRD_VM_LIST: printf("BRD_VM_LIST\n"); return;
         case BRD_VM_PUSH: printf("BRD_VM_PUSH\n"); return;
         case BRD_VM_PUSH_DICT: printf("BRD_VM_PUSH_DICT\n"); return;
+        case BRD_VM_NEW_LIST: printf("BRD_VM_NEW_LIST\n"); return;
+        case BRD_VM_NEW_DICT: printf("BRD_VM_NEW_DICT\n"); return;
+        case BRD_VM_ITER_INIT: printf("BRD_VM_ITER_INIT\n"); return;
+        case BRD_VM_ITER_NEXT: printf("BRD_VM_ITER_NEXT\n"); return;
+        case BRD_VM_GC: printf("BRD_VM_GC\n"); return;
+        case BRD_VM_UNSET_VAR: printf("BRD_VM_UNSET_VAR\n"); return;
         case BRD_VM_GET_IDX: printf("BRD_VM_GET_IDX\n"); return;
         case BRD_VM_SET_IDX: printf("BRD_VM_SET_IDX\n"); return;
         case BRD_VM_GET_FIELD: printf("BRD_VM_GET_FIELD\n"); return;
@@ -92,8 +101,11 @@ void
 brd_vm_allocate(struct brd_heap_entry *entry)
 {
         vm.heap_size++;
+        gc_stats.bytes_allocated += brd_heap_size(entry);
+        entry->marked = false;
         entry->next = vm.heap->next;
         vm.heap->next = entry;
+        brd_gc_sweep_step();
 }
 
 struct brd_string_constant_list *
@@ -118,6 +130,9 @@ brd_vm_add_string_constant(char *string)
         entry->string.s = malloc(length + 1);
         strcpy(entry->string.s, string);
         entry->string.length = length;
+        entry->string.rope = NULL;
+        entry->string.hash = 0;
+        entry->string.num_state = BRD_STRING_NUM_UNKNOWN;
         entry->next = vm.strings;
         vm.strings = entry;
         return entry;
@@ -186,11 +201,36 @@ brd_node_compile_lvalue(struct brd_node *node)
         }
 }
 
-void
-brd_node_compile(struct brd_node *node)
+/*
+ * Whether compiling node leaves only its own value on the stack. Literals
+ * only put these items on the stack before building, since other items
+ * (nested literals especially) need stack space of their own
+ */
+static int
+brd_node_is_flat(struct brd_node *node)
+{
+        switch (node->ntype) {
+        case BRD_NODE_VAR:
+        case BRD_NODE_NUM_LIT:
+        case BRD_NODE_STRING_LIT:
+        case BRD_NODE_BOOL_LIT:
+        case BRD_NODE_UNIT_LIT:
+                return true;
+        default:
+                return false;
+        }
+}
+
+/*
+ * used is false when the value of the node is only going to be popped,
+ * in which case loops don't bother building their list of values
+ */
+static void
+brd_node_compile_value(struct brd_node *node, int used)
 {
         enum brd_bytecode op;
-        size_t temp, temp2, jmp, *ifexpr_temps;
+        size_t temp, temp2, jmp, *ifexpr_temps, num_items, chunk;
+        int no_list;
 
         switch (node->ntype) {
         case BRD_NODE_ASSIGN: 
@@ -258,8 +298,19 @@ mkbinop:
                 ADD_OP(BRD_VM_UNIT);
                 break;
         case BRD_NODE_LIST_LIT:
-                ADD_OP(BRD_VM_LIST);
-                for (size_t i = 0; i < AS(list_lit, node)->items->num_args; i++) {
+                num_items = AS(list_lit, node)->items->num_args;
+                chunk = 0;
+                while (chunk < num_items && chunk < LITERAL_CHUNK
+                                && brd_node_is_flat(AS(list_lit, node)->items->args[chunk])) {
+                        chunk++;
+                }
+                for (size_t i = 0; i < chunk; i++) {
+                        brd_node_compile(AS(list_lit, node)->items->args[i]);
+                }
+                ADD_OP(BRD_VM_NEW_LIST);
+                ADD_SIZET(num_items);
+                ADD_SIZET(chunk);
+                for (size_t i = chunk; i < num_items; i++) {
                         brd_node_compile(AS(list_lit, node)->items->args[i]);
                         ADD_OP(BRD_VM_PUSH);
                 }
@@ -292,9 +343,11 @@ mkbinop:
                 break;
         case BRD_NODE_BODY:
                 for (size_t i = 0; i < AS(body, node)->num_stmts; i++) {
-                        brd_node_compile(AS(body, node)->stmts[i]);
                         if (i < AS(body, node)->num_stmts - 1) {
+                                brd_node_compile_value(AS(body, node)->stmts[i], false);
                                 ADD_OP(BRD_VM_POP);
+                        } else {
+                                brd_node_compile_value(AS(body, node)->stmts[i], used);
                         }
                 }
                 break;
@@ -310,7 +363,7 @@ mkbinop:
                 ADD_OP(BRD_VM_JMP);
                 temp = vm.bc_length;
                 ADD_SIZET(0);
-                brd_node_compile(AS(ifexpr, node)->body);
+                brd_node_compile_value(AS(ifexpr, node)->body, used);
                 ADD_OP(BRD_VM_JMP);
                 ifexpr_temps[0] = vm.bc_length;
                 ADD_SIZET(0);
@@ -323,7 +376,7 @@ mkbinop:
                         ADD_OP(BRD_VM_JMP);
                         temp = vm.bc_length;
                         ADD_SIZET(0);
-                        brd_node_compile(AS(ifexpr, node)->elifs[i].body);
+                        brd_node_compile_value(AS(ifexpr, node)->elifs[i].body, used);
                         ADD_OP(BRD_VM_JMP);
                         ifexpr_temps[i+1] = vm.bc_length;
                         ADD_SIZET(0);
@@ -332,7 +385,7 @@ mkbinop:
                 }
 
                 if (AS(ifexpr, node)->els != NULL) {
-                        brd_node_compile(AS(ifexpr, node)->els);
+                        brd_node_compile_value(AS(ifexpr, node)->els, used);
                 } else {
                         ADD_OP(BRD_VM_UNIT);
                 }
@@ -345,7 +398,8 @@ mkbinop:
                 free(ifexpr_temps);
                 break;
         case BRD_NODE_WHILE:
-                if (!AS(while, node)->no_list) {
+                no_list = AS(while, node)->no_list || !used;
+                if (!no_list) {
                         ADD_OP(BRD_VM_LIST);
                 }
                 temp = vm.bc_length;
@@ -354,14 +408,14 @@ mkbinop:
                 ADD_OP(BRD_VM_JMP);
                 temp2 = vm.bc_length;
                 ADD_SIZET(0);
-                brd_node_compile(AS(while, node)->body);
-                if (!AS(while, node)->no_list) {
+                brd_node_compile_value(AS(while, node)->body, !no_list);
+                if (!no_list) {
                         ADD_OP(BRD_VM_PUSH);
                 } else {
                         ADD_OP(BRD_VM_POP);
                 }
                 if (AS(while, node)->inc != NULL) {
-                        brd_node_compile(AS(while, node)->inc);
+                        brd_node_compile_value(AS(while, node)->inc, false);
                         ADD_OP(BRD_VM_POP);
                 }
                 ADD_OP(BRD_VM_JMPB);
@@ -369,7 +423,37 @@ mkbinop:
                 ADD_SIZET(jmp);
                 jmp = vm.bc_length - temp2;
                 *(size_t *)(vm.bytecode + temp2) = jmp;
-                if (AS(while, node)->no_list) {
+                if (no_list) {
+                        ADD_OP(BRD_VM_UNIT);
+                }
+                break;
+        case BRD_NODE_FOR_IN:
+                no_list = AS(for_in, node)->no_list || !used;
+                brd_node_compile(AS(for_in, node)->iter);
+                ADD_OP(BRD_VM_ITER_INIT);
+                if (!no_list) {
+                        ADD_OP(BRD_VM_LIST);
+                }
+                temp = vm.bc_length;
+                ADD_OP(BRD_VM_ITER_NEXT);
+                ADD_SIZET(!no_list);
+                temp2 = vm.bc_length;
+                ADD_SIZET(0);
+                ADD_OP(BRD_VM_SET_VAR);
+                ADD_STR(AS(for_in, node)->var);
+                ADD_OP(BRD_VM_POP);
+                brd_node_compile_value(AS(for_in, node)->body, !no_list);
+                if (!no_list) {
+                        ADD_OP(BRD_VM_PUSH);
+                } else {
+                        ADD_OP(BRD_VM_POP);
+                }
+                ADD_OP(BRD_VM_JMPB);
+                jmp = vm.bc_length - temp;
+                ADD_SIZET(jmp);
+                jmp = vm.bc_length - temp2;
+                *(size_t *)(vm.bytecode + temp2) = jmp;
+                if (no_list) {
                         ADD_OP(BRD_VM_UNIT);
                 }
                 break;
@@ -394,19 +478,43 @@ mkbinop:
                 }
                 break;
         case BRD_NODE_DICT:
-                ADD_OP(BRD_VM_BUILTIN); // kind of a hack, but it works
-                ADD_SIZET(BRD_BUILTIN_DICT); // and I don't have to add
-                ADD_OP(BRD_VM_CALL); // a new bytecode op
-                ADD_SIZET(0);
-                for (size_t i = 0; i < AS(dict, node)->num_pairs; i++) {
+                num_items = AS(dict, node)->num_pairs;
+                chunk = 0;
+                while (chunk < num_items && chunk < LITERAL_CHUNK
+                                && brd_node_is_flat(AS(dict, node)->pairs[chunk].value)) {
+                        chunk++;
+                }
+                for (size_t i = 0; i < chunk; i++) {
+                        brd_node_compile(AS(dict, node)->pairs[i].value);
+                }
+                ADD_OP(BRD_VM_NEW_DICT);
+                ADD_SIZET(num_items);
+                ADD_SIZET(chunk);
+                for (size_t i = 0; i < chunk; i++) {
+                        ADD_STR(AS(dict, node)->pairs[i].key);
+                }
+                for (size_t i = chunk; i < num_items; i++) {
                         brd_node_compile(AS(dict, node)->pairs[i].value);
                         ADD_OP(BRD_VM_PUSH_DICT);
                         ADD_STR(AS(dict, node)->pairs[i].key);
                 }
                 break;
+        case BRD_NODE_INLINE:
+                brd_node_compile_value(AS(inline, node)->body, used);
+                /* the arguments would otherwise stay alive after the call */
+                for (size_t i = 0; i < AS(inline, node)->num_temps; i++) {
+                        ADD_OP(BRD_VM_UNSET_VAR);
+                        ADD_STR(AS(inline, node)->temps[i]);
+                }
+                ADD_OP(BRD_VM_GC);
+                break;
         case BRD_NODE_PROGRAM:
+                /* the repl keeps the value of the last statement */
                 for (size_t i = 0; i < AS(program, node)->num_stmts; i++) {
-                        brd_node_compile(AS(program, node)->stmts[i]);
+                        brd_node_compile_value(
+                                AS(program, node)->stmts[i],
+                                i == AS(program, node)->num_stmts - 1
+                        );
                         ADD_OP(BRD_VM_POP);
                 }
                 ADD_OP(BRD_VM_RETURN);
@@ -414,6 +522,12 @@ mkbinop:
         }
 }
 
+void
+brd_node_compile(struct brd_node *node)
+{
+        brd_node_compile_value(node, true);
+}
+
 #undef ADD_OP
 #undef ADD_NUM
 #undef ADD_STR
@@ -422,6 +536,9 @@ mkbinop:
 void
 brd_vm_destroy(void)
 {
+        /* puts anything still waiting to be swept back in the heap */
+        brd_gc_destroy();
+
         /* destroy globals */
         brd_heap_destroy(object_class.as.heap);
 
@@ -459,9 +576,7 @@ brd_vm_init(void)
         vm.stack.sp = vm.stack.values;
 
         vm.strings = malloc(sizeof(*vm.strings));
-        vm.strings->string.s = malloc(1);
-        vm.strings->string.s[0] = '\0';
-        vm.strings->string.length = 0;
+        brd_value_string_init(&vm.strings->string, strdup(""));
         vm.strings->next = NULL;
 
         /* the initial instructions are for the @Object constructor */
@@ -476,6 +591,9 @@ brd_vm_init(void)
 
         vm.threshold = INITIAL_THRESHOLD;
         vm.heap_size = 0;
+
+        brd_value_init_string_constants();
+        brd_gc_init();
 }
 
 static void
@@ -505,16 +623,28 @@ brd_value_call_closure(
         }
 }
 
+/* args are the top num_args values of the stack, which the call pops */
 static void
 brd_value_call(struct brd_value *f, struct brd_value *args, size_t num_args)
 {
         if (IS_VAL(*f, BRD_VAL_BUILTIN)) {
                 struct brd_value out;
+
+                /*
+                 * the arguments stay on the stack while the builtin runs,
+                 * since it may call back into the vm
+                 */
                 if (builtin_function[f->as.builtin](args, num_args, &out)) {
                         brd_vm_allocate(out.as.heap);
                 }
+                vm.stack.sp = args;
                 brd_stack_push(&vm.stack, &out);
-        } else if (IS_HEAP(*f, BRD_HEAP_CLOSURE)) {
+                return;
+        }
+
+        /* otherwise they're copied into the new frame's locals */
+        vm.stack.sp = args;
+        if (IS_HEAP(*f, BRD_HEAP_CLOSURE)) {
                 brd_value_call_closure(f->as.heap->as.closure, args, num_args, NULL);
         } else if (IS_HEAP(*f, BRD_HEAP_CLASS)) {
                 struct brd_value object;
@@ -586,16 +716,21 @@ brd_value_acc_obj(struct brd_value *object, char *id)
         }
 }
 
-void
-brd_vm_run(void)
+/*
+ * Run until a RETURN brings the frame pointer back down to stop_fp,
+ * or until the program's final RETURN
+ */
+static void
+brd_vm_run_until(size_t stop_fp)
 {
         enum brd_bytecode op;
         enum brd_builtin b;
         struct brd_value value1, value2, value3, *valuep;
         struct brd_comparison cmp;
         char *id;
+        unsigned long h;
         char **args;
-        size_t jmp, num_args;
+        size_t jmp, num_args, depth, pos;
 
 #define READ_STRING_INTO(v) do {\
         v = &(*(struct brd_string_constant_list **)(vm.bytecode + vm.frame[vm.fp].pc))\
@@ -626,9 +761,10 @@ brd_vm_run(void)
                 case BRD_VM_GET_VAR:
                         READ_STRING_INTO(value1.as.string);
                         id = value1.as.string->s;
-                        valuep = brd_value_map_get(&vm.frame[vm.fp].locals, id);
+                        h = brd_value_string_hash(value1.as.string);
+                        valuep = brd_value_map_get_hashed(&vm.frame[vm.fp].locals, id, h);
                         if (valuep == NULL) {
-                                valuep = brd_value_map_get(&vm.frame[vm.fp].globals, id);
+                                valuep = brd_value_map_get_hashed(&vm.frame[vm.fp].globals, id, h);
                                 if (valuep == NULL) {
                                         value1.vtype = BRD_VAL_UNIT;
                                         brd_stack_push(&vm.stack, &value1);
@@ -693,8 +829,9 @@ brd_vm_run(void)
                 case BRD_VM_CONCAT:
                         value1 = *brd_stack_pop(&vm.stack);
                         value2 = *brd_stack_pop(&vm.stack);
-                        brd_value_concat(&value2, &value1);
-                        brd_vm_allocate(value2.as.heap);
+                        if (brd_value_concat(&value2, &value1)) {
+                                brd_vm_allocate(value2.as.heap);
+                        }
                         brd_stack_push(&vm.stack, &value2);
                         break;
 #define M(op)\
@@ -712,9 +849,8 @@ brd_vm_run(void)
                 case BRD_VM_EQ:
                         value1 = *brd_stack_pop(&vm.stack);
                         value2 = *brd_stack_pop(&vm.stack);
-                        cmp = brd_value_compare(&value2, &value1);
+                        value2.as.boolean = brd_value_equals(&value2, &value1);
                         value2.vtype = BRD_VAL_BOOL;
-                        value2.as.boolean = brd_comparison_eq(cmp);
                         brd_stack_push(&vm.stack, &value2);
                         break;
                 case BRD_VM_NEGATE:
@@ -752,12 +888,13 @@ brd_vm_run(void)
                 case BRD_VM_SET_VAR:
                         READ_STRING_INTO(value1.as.string);
                         id = value1.as.string->s;
+                        h = brd_value_string_hash(value1.as.string);
                         value1 = *brd_stack_pop(&vm.stack);
-                        valuep = brd_value_map_get(&vm.frame[vm.fp].globals, id);
+                        valuep = brd_value_map_get_hashed(&vm.frame[vm.fp].globals, id, h);
                         if (valuep != NULL) {
                                 *valuep = value1;
                         } else {
-                                brd_value_map_set(&vm.frame[vm.fp].locals, id, &value1);
+                                brd_value_map_set_hashed(&vm.frame[vm.fp].locals, id, h, &value1);
                         }
                         brd_stack_push(&vm.stack, &value1);
                         break;
@@ -784,8 +921,7 @@ brd_vm_run(void)
                         num_args = *(size_t *)(vm.bytecode + vm.frame[vm.fp].pc);
                         vm.frame[vm.fp].pc += sizeof(size_t);
                         value1 = *brd_stack_pop(&vm.stack);
-                        vm.stack.sp -= num_args;
-                        brd_value_call(&value1, vm.stack.sp, num_args);
+                        brd_value_call(&value1, vm.stack.sp - num_args, num_args);
                         break;
                 case BRD_VM_CLOSURE:
                         value1.vtype = BRD_VAL_HEAP;
@@ -861,6 +997,13 @@ brd_vm_run(void)
                                         floorl(value1.as.num),
                                         &value3
                                 );
+                        } else if (IS_HEAP(value2, BRD_HEAP_ARRAY)) {
+                                brd_value_coerce_num(&value1);
+                                brd_value_array_set(
+                                        value2.as.heap->as.array,
+                                        floorl(value1.as.num),
+                                        &value3
+                                );
                         } else {
                                 BARF("bad type for set index");
                         }
@@ -878,6 +1021,69 @@ brd_vm_run(void)
                         value3 = *brd_stack_peek(&vm.stack);
                         brd_value_dict_set(value3.as.heap->as.dict, &value1, &value2);
                         break;
+                case BRD_VM_NEW_LIST:
+                        depth = *(size_t *)(vm.bytecode + vm.frame[vm.fp].pc);
+                        vm.frame[vm.fp].pc += sizeof(size_t);
+                        num_args = *(size_t *)(vm.bytecode + vm.frame[vm.fp].pc);
+                        vm.frame[vm.fp].pc += sizeof(size_t);
+                        vm.stack.sp -= num_args;
+                        value1.vtype = BRD_VAL_HEAP;
+                        value1.as.heap = brd_heap_new(BRD_HEAP_LIST);
+                        brd_value_list_init_items(
+                                value1.as.heap->as.list,
+                                vm.stack.sp,
+                                num_args,
+                                depth
+                        );
+                        brd_vm_allocate(value1.as.heap);
+                        brd_stack_push(&vm.stack, &value1);
+                        break;
+                case BRD_VM_NEW_DICT:
+                        depth = *(size_t *)(vm.bytecode + vm.frame[vm.fp].pc);
+                        vm.frame[vm.fp].pc += sizeof(size_t);
+                        num_args = *(size_t *)(vm.bytecode + vm.frame[vm.fp].pc);
+                        vm.frame[vm.fp].pc += sizeof(size_t);
+                        vm.stack.sp -= num_args;
+                        value1.vtype = BRD_VAL_HEAP;
+                        value1.as.heap = brd_heap_new(BRD_HEAP_DICT);
+                        brd_value_dict_init_with_size(value1.as.heap->as.dict, depth);
+                        value2.vtype = BRD_VAL_STRING;
+                        for (size_t i = 0; i < num_args; i++) {
+                                READ_STRING_INTO(value2.as.string);
+                                brd_value_dict_set(
+                                        value1.as.heap->as.dict,
+                                        &value2,
+                                        &vm.stack.sp[i]
+                                );
+                        }
+                        brd_vm_allocate(value1.as.heap);
+                        brd_stack_push(&vm.stack, &value1);
+                        break;
+                case BRD_VM_ITER_INIT:
+                        if (!brd_value_iterable(brd_stack_peek(&vm.stack))) {
+                                BARF("can only iterate over strings, lists, dicts, sets, arrays and ranges");
+                        }
+                        value1.vtype = BRD_VAL_NUM;
+                        value1.as.num = 0;
+                        brd_stack_push(&vm.stack, &value1);
+                        break;
+                case BRD_VM_ITER_NEXT:
+                        depth = *(size_t *)(vm.bytecode + vm.frame[vm.fp].pc);
+                        vm.frame[vm.fp].pc += sizeof(size_t);
+                        valuep = vm.stack.sp - depth - 2;
+                        pos = valuep[1].as.num;
+                        if (brd_value_iter_next(&valuep[0], &pos, &value1)) {
+                                valuep[1].as.num = pos;
+                                vm.frame[vm.fp].pc += sizeof(size_t);
+                                brd_stack_push(&vm.stack, &value1);
+                        } else {
+                                /* done, so take the iterator out from under the loop's list */
+                                memmove(valuep, valuep + 2, depth * sizeof(*valuep));
+                                vm.stack.sp -= 2;
+                                jmp = *(size_t *)(vm.bytecode + vm.frame[vm.fp].pc);
+                                vm.frame[vm.fp].pc += jmp;
+                        }
+                        break;
                 case BRD_VM_GET_FIELD:
                         READ_STRING_INTO(value1.as.string);
                         id = value1.as.string->s;
@@ -941,6 +1147,17 @@ brd_vm_run(void)
                                 id, &value1
                         );
                         break;
+                case BRD_VM_GC:
+                        brd_vm_gc();
+                        break;
+                case BRD_VM_UNSET_VAR:
+                        READ_STRING_INTO(value1.as.string);
+                        brd_value_map_remove_hashed(
+                                &vm.frame[vm.fp].locals,
+                                value1.as.string->s,
+                                brd_value_string_hash(value1.as.string)
+                        );
+                        break;
                 case BRD_VM_RETURN:
                         if (vm.fp == 0) {
                                 goto exit_loop;
@@ -948,6 +1165,9 @@ brd_vm_run(void)
                                 brd_value_map_destroy(&vm.frame[vm.fp].locals);
                                 vm.fp--;
                                 brd_vm_gc();
+                                if (vm.fp == stop_fp) {
+                                        goto exit_loop;
+                                }
                         }
                         break;
                 case BRD_VM_POP:
@@ -969,57 +1189,45 @@ exit_loop:
 }
 
 void
-brd_vm_gc(void)
+brd_vm_run(void)
 {
-        struct brd_heap_entry *heap, *prev;
-
-        if (vm.heap_size < vm.threshold) {
-                return;
-        }
-#ifdef DEBUG
-        printf("GC starting... ");
-#endif
+        brd_vm_run_until(FRAME_SIZE);
+}
 
-        heap = vm.heap->next;
-        while (heap != NULL) {
-                heap->marked = false;
-                heap = heap->next;
-        }
-        object_class.as.heap->marked = true;
+/*
+ * Call f from native code, leaving its return value in out.
+ * The arguments are rooted while f runs, but not by the time it has
+ * returned. Anything the caller holds on to across the call, including
+ * the value of an earlier call, has to be rooted with brd_vm_root.
+ */
+void
+brd_vm_call(struct brd_value *f, struct brd_value *args, size_t num_args, struct brd_value *out)
+{
+        size_t fp = vm.fp;
 
-        /* mark values in the stack */
-        for (struct brd_value *p = vm.stack.values; p < vm.stack.sp; p++) {
-                brd_value_gc_mark(p);
+        for (size_t i = 0; i < num_args; i++) {
+                brd_stack_push(&vm.stack, &args[i]);
         }
-
-        /* mark values held by variables */
-        for (size_t i = 0; i <= vm.fp; i++) {
-                brd_value_map_mark(&vm.frame[i].globals);
-                brd_value_map_mark(&vm.frame[i].locals);
+        brd_value_call(f, vm.stack.sp - num_args, num_args);
+        if (vm.fp > fp) {
+                brd_vm_run_until(fp);
         }
+        *out = *brd_stack_pop(&vm.stack);
+}
 
-        prev = vm.heap;
-        heap = prev->next;
-        while (heap != NULL) {
-                struct brd_heap_entry *next = heap->next;
-                if (heap->marked) {
-                        prev = heap;
-                        heap = next;
-                        continue;
-                }
-
-                vm.heap_size--;
-                prev->next = next;
-                brd_heap_destroy(heap);
-                heap = next;
-        }
+/*
+ * Keep a value alive while native code calls back into the vm. Roots
+ * live on the stack, so they're released with brd_vm_unroot in the
+ * reverse order they were added.
+ */
+void
+brd_vm_root(struct brd_value *value)
+{
+        brd_stack_push(&vm.stack, value);
+}
 
-        if (vm.heap_size >= vm.threshold) {
-                vm.threshold *= 1.5;
-        } else if (vm.heap_size < INITIAL_THRESHOLD) {
-                vm.threshold = INITIAL_THRESHOLD;
-        }
-#ifdef DEBUG
-        printf("finished\n");
-#endif
+void
+brd_vm_unroot(size_t num_values)
+{
+        vm.stack.sp -= num_values;
 }
@@ -75,6 +75,29 @@ enum brd_bytecode {
         /* this is poorly named, it's a list operation */
         BRD_VM_PUSH, /* x = pop(), peek().push(x) */
         BRD_VM_PUSH_DICT,
+        /*
+         * literals, NEW_LIST has args: size_t capacity, size_t n
+         * NEW_DICT has args: size_t size, size_t n, then n keys
+         * both pop n values into a collection presized for the whole
+         * literal, the rest of the items are added with PUSH/PUSH_DICT
+         */
+        BRD_VM_NEW_LIST,
+        BRD_VM_NEW_DICT,
+
+        /* for in loops */
+        BRD_VM_ITER_INIT, /* x = pop(), push(x), push(0) */
+        BRD_VM_ITER_NEXT, /* has args: size_t depth, size_t jmp */
+        /*
+         * the iterator sits depth values below the top of the stack,
+         * ITER_NEXT pushes its next item or removes it and jumps
+         */
+
+        /*
+         * collects garbage if it's due, this stands in for the
+         * collection at RETURN when a closure call has been inlined
+         */
+        BRD_VM_GC,
+        BRD_VM_UNSET_VAR, /* has arg: string, removes it from the locals */
 };
 
 struct brd_stack {
@@ -90,6 +113,7 @@ struct brd_frame {
 
 struct brd_string_constant_list {
         struct brd_string_constant_list *next;
+        char _p[8];
         struct brd_value_string string;
 };
 
@@ -118,6 +142,9 @@ void brd_vm_init(void);
 void brd_vm_allocate(struct brd_heap_entry *entry);
 struct brd_string_constant_list *brd_vm_add_string_constant(char *string);
 void brd_vm_run(void);
+void brd_vm_call(struct brd_value *f, struct brd_value *args, size_t num_args, struct brd_value *out);
+void brd_vm_root(struct brd_value *value);
+void brd_vm_unroot(size_t num_values);
 
 void brd_vm_gc(void);
 #endif